@@ -0,0 +1,176 @@
+#ifndef __ARENA_ALLOCATOR_HPP
+#define __ARENA_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Arena -- the memory behind every copy of an ArenaAllocator.
+//
+// Memory is carved out of large chunks by bumping a pointer. Blocks that
+// are given back are kept on a free list for their size class and reused
+// by the next request of that size, so a container that erases and
+// inserts does not keep growing. Nothing is returned to the system until
+// the Arena itself is destroyed, which frees every chunk at once.
+class Arena
+{
+public:
+	explicit Arena(size_t chunkBytes = DEFAULT_CHUNK_BYTES)
+		: chunk_bytes(chunkBytes < GRANULE ? GRANULE : chunkBytes),
+		  cur(nullptr), end(nullptr), reserved(0)
+	{
+		for (size_t i = 0; i < SIZE_CLASSES; i++) { free_lists[i] = nullptr; }
+	}
+
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	~Arena()
+	{
+		for (void* chunk : chunks) { ::operator delete(chunk); }
+	}
+
+	void* allocate(size_t bytes, size_t align)
+	{
+		bytes = roundUp(bytes == 0 ? 1 : bytes);
+		size_t cls = bytes / GRANULE;
+		if (align <= GRANULE && cls < SIZE_CLASSES && free_lists[cls] != nullptr)
+		{
+			FreeBlock* b = free_lists[cls];
+			free_lists[cls] = b->next;
+			return b;
+		}
+		// requests bigger than a quarter chunk get a chunk of their own
+		if (bytes + align > chunk_bytes / 4)
+		{
+			return newChunk(bytes + align, align, false);
+		}
+		char* p = alignPtr(cur, align);
+		if (cur == nullptr || p + bytes > end)
+		{
+			return newChunk(bytes, align, true);
+		}
+		cur = p + bytes;
+		return p;
+	}
+
+	void deallocate(void* p, size_t bytes, size_t align) noexcept
+	{
+		bytes = roundUp(bytes == 0 ? 1 : bytes);
+		size_t cls = bytes / GRANULE;
+		if (align <= GRANULE && cls < SIZE_CLASSES)
+		{
+			FreeBlock* b = static_cast<FreeBlock*>(p);
+			b->next = free_lists[cls];
+			free_lists[cls] = b;
+		}
+		// anything else stays put until the arena goes away
+	}
+
+	// How many chunks has this arena taken from the system?
+	size_t chunkCount() const noexcept { return chunks.size(); }
+
+	// Total bytes held in chunks, used or not.
+	size_t bytesReserved() const noexcept { return reserved; }
+
+	static constexpr size_t DEFAULT_CHUNK_BYTES = 64 * 1024;
+
+private:
+	static constexpr size_t GRANULE = alignof(std::max_align_t);
+	static constexpr size_t SIZE_CLASSES = 64;
+
+	struct FreeBlock { FreeBlock* next; };
+
+	static size_t roundUp(size_t bytes) noexcept
+	{
+		return (bytes + GRANULE - 1) / GRANULE * GRANULE;
+	}
+
+	static char* alignPtr(char* p, size_t align) noexcept
+	{
+		size_t addr = reinterpret_cast<size_t>(p);
+		return p + ((align - addr % align) % align);
+	}
+
+	void* newChunk(size_t bytes, size_t align, bool makeCurrent)
+	{
+		size_t size = makeCurrent ? chunk_bytes : bytes;
+		if (makeCurrent && bytes + align > size) { size = bytes + align; }
+		chunks.reserve(chunks.size() + 1);
+		char* chunk = static_cast<char*>(::operator new(size));
+		chunks.push_back(chunk);
+		reserved += size;
+
+		char* p = alignPtr(chunk, align);
+		if (makeCurrent)
+		{
+			cur = p + bytes;
+			end = chunk + size;
+		}
+		return p;
+	}
+
+	size_t chunk_bytes;
+	char* cur;
+	char* end;
+	size_t reserved;
+	std::vector<void*> chunks;
+	FreeBlock* free_lists[SIZE_CLASSES];
+};
+
+// ArenaAllocator -- a standard allocator that draws from an Arena.
+//
+// A default-constructed ArenaAllocator owns a fresh Arena; copies and
+// rebound copies share it, and the Arena is freed when the last one goes
+// away. Containers that see `releases_in_bulk` may skip deallocating
+// their elements one by one on destruction.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+	using releases_in_bulk = std::true_type;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	explicit ArenaAllocator(size_t chunkBytes = Arena::DEFAULT_CHUNK_BYTES)
+		: arena_(std::make_shared<Arena>(chunkBytes)) {}
+
+	explicit ArenaAllocator(std::shared_ptr<Arena> a) : arena_(std::move(a)) {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U> & other) noexcept : arena_(other.sharedArena()) {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n) noexcept
+	{
+		arena_->deallocate(p, n * sizeof(T), alignof(T));
+	}
+
+	Arena & arena() const noexcept { return *arena_; }
+	const std::shared_ptr<Arena> & sharedArena() const noexcept { return arena_; }
+
+private:
+	std::shared_ptr<Arena> arena_;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) noexcept
+{
+	return &a.arena() == &b.arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b) noexcept
+{
+	return !(a == b);
+}
+
+#endif
@@ -0,0 +1,916 @@
+#ifndef ___CONCURRENT_SKIP_LIST_HPP
+#define ___CONCURRENT_SKIP_LIST_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+#include "SkipList.hpp" // for flipCoin and layerCapFor
+#include "runtimeexcept.hpp"
+
+// EpochManager -- epoch-based reclamation for lock-free structures.
+//
+// A thread pins the manager (see Guard) for as long as it may hold raw
+// pointers into the structure. Memory unlinked by a writer is retired
+// together with the global epoch at that moment and is only freed once
+// the global epoch has moved two steps past it. The epoch can only move
+// when every pinned thread has observed the current one, so a pinned
+// reader can never see a node freed under it.
+//
+// Pinning claims one of MAX_SLOTS per-thread slots; it only waits when
+// that many threads are pinned at the same time.
+class EpochManager
+{
+private:
+	static constexpr uint64_t IDLE = ~uint64_t(0);
+	static constexpr size_t RETIRE_BATCH = 64;
+
+	struct Retired
+	{
+		void* p;
+		void (*deleter)(void*);
+		uint64_t epoch;
+	};
+
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> epoch{IDLE};
+		std::atomic<bool> in_use{false};
+		std::vector<Retired> limbo; // only touched by the thread holding in_use
+	};
+
+public:
+	static constexpr unsigned MAX_SLOTS = 128;
+
+	class Guard
+	{
+	public:
+		Guard(Guard && other) noexcept : mgr(other.mgr), slot(other.slot) { other.mgr = nullptr; }
+		Guard(const Guard &) = delete;
+		Guard & operator=(const Guard &) = delete;
+		~Guard() { if (mgr != nullptr) { mgr->unpin(*slot); } }
+
+		// Hand p to the manager; deleter(p) runs once no pinned thread can
+		// still reach it. p must already be unreachable for new readers.
+		void retire(void* p, void (*deleter)(void*)) { mgr->retire(*slot, p, deleter); }
+
+	private:
+		friend class EpochManager;
+		Guard(EpochManager* m, Slot* s) noexcept : mgr(m), slot(s) {}
+
+		EpochManager* mgr;
+		Slot* slot;
+	};
+
+	EpochManager() : global_epoch(0) {}
+	EpochManager(const EpochManager &) = delete;
+	EpochManager & operator=(const EpochManager &) = delete;
+
+	// No thread may be pinned when the manager is destroyed.
+	~EpochManager()
+	{
+		for (Slot & s : slots)
+		{
+			for (Retired & r : s.limbo) { r.deleter(r.p); }
+		}
+	}
+
+	Guard pin()
+	{
+		static std::atomic<unsigned> nextHint{0};
+		static thread_local unsigned hint = nextHint.fetch_add(1, std::memory_order_relaxed);
+
+		for (unsigned probes = 0; ; probes++)
+		{
+			Slot & s = slots[(hint + probes) % MAX_SLOTS];
+			if (!s.in_use.load(std::memory_order_relaxed) &&
+			    !s.in_use.exchange(true, std::memory_order_acquire))
+			{
+				s.epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+				return Guard(this, &s);
+			}
+			if (probes % MAX_SLOTS == MAX_SLOTS - 1) { std::this_thread::yield(); }
+		}
+	}
+
+private:
+	void unpin(Slot & s) noexcept
+	{
+		s.epoch.store(IDLE, std::memory_order_release);
+		s.in_use.store(false, std::memory_order_release);
+	}
+
+	void retire(Slot & s, void* p, void (*deleter)(void*))
+	{
+		s.limbo.push_back(Retired{p, deleter, global_epoch.load(std::memory_order_seq_cst)});
+		if (s.limbo.size() >= RETIRE_BATCH)
+		{
+			tryAdvance();
+			collect(s);
+		}
+	}
+
+	void tryAdvance() noexcept
+	{
+		uint64_t e = global_epoch.load(std::memory_order_seq_cst);
+		for (Slot & s : slots)
+		{
+			uint64_t local = s.epoch.load(std::memory_order_seq_cst);
+			if (local != IDLE && local != e) { return; }
+		}
+		global_epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst);
+	}
+
+	void collect(Slot & s) noexcept
+	{
+		uint64_t e = global_epoch.load(std::memory_order_seq_cst);
+		size_t kept = 0;
+		for (size_t i = 0; i < s.limbo.size(); i++)
+		{
+			if (s.limbo[i].epoch + 2 <= e) {
+				s.limbo[i].deleter(s.limbo[i].p);
+			} else {
+				s.limbo[kept++] = s.limbo[i];
+			}
+		}
+		s.limbo.resize(kept);
+	}
+
+	std::atomic<uint64_t> global_epoch;
+	Slot slots[MAX_SLOTS];
+};
+
+
+// ConcurrentSkipList -- a lock-free skip list in the style of
+// Herlihy/Shavit and Fraser.
+//
+// Nodes are towers like SkipList's: one allocation per key with an inline
+// array of forward links. Each link keeps a "marked" flag in its low bit;
+// a marked link means its node is being removed at that layer. insert
+// links a tower bottom-up with CAS. Readers (find, contains, nextKey, ...)
+// never change the structure: they step over marked nodes instead of
+// unlinking them. Besides pinning their own epoch slot, the only shared
+// memory they write is a node's born or died version when they settle it
+// (see below). Memory is protected by an EpochManager.
+//
+// Values are copied out rather than returned by reference, because a
+// reference could outlive the node. Heights use SkipList's flipCoin rule
+// under the cap a SkipList adapts to by default (layerCapFor), limited to
+// MAX_LEVEL layers; there is no setMaxLayers.
+//
+// Snapshots read at versions of a global clock that only snapshot() ever
+// advances. A node records the version at which it was inserted (born)
+// and erased (died), each settled *after* the write is visible: the clock
+// read once the node is linked, or once it is marked dead. A write that
+// settles at or below a snapshot's version was therefore already visible
+// when the snapshot opened, and one that settles above it is after it, so
+// the snapshot sees exactly the nodes with born <= version < died. A
+// reader that meets a node whose write has not settled yet settles it
+// itself, so no reader waits for a writer and no writer waits for
+// another; writers only read the clock, and for as long as no snapshot
+// is taken nothing writes it. So that snapshots can see old nodes, an
+// erase only marks its node dead while a snapshot that old is open; the
+// node stays linked (newer nodes for the same key go in front of it) and
+// is unlinked and retired once the last such snapshot closes.
+template<typename Key, typename Value>
+class ConcurrentSkipList
+{
+private:
+    // died of a node not erased / erased, its version not settled yet;
+    // born of a node linked, its version not settled yet (newer than any)
+    static constexpr uint64_t LIVE = ~uint64_t(0);
+    static constexpr uint64_t DYING = LIVE - 1;
+    static constexpr uint64_t UNBORN = ~uint64_t(0);
+
+	class Node{
+    public:
+        Key key;
+        Value val;
+        unsigned height;
+        // set once insert has stopped linking upper layers; erase waits for
+        // it so that no layer can be re-linked after the final unlink
+        std::atomic<bool> linked;
+        // the versions that inserted and erased the key, see settleBirth
+        // and settleDeath; died goes LIVE -> DYING by the one erase that
+        // wins the node
+        std::atomic<uint64_t> born;
+        std::atomic<uint64_t> died;
+
+        std::atomic<uintptr_t> next[1]; // must stay last, see makeNode
+
+        explicit Node(unsigned h): key(), val(), height(h), linked(true), born(0), died(LIVE){}
+
+        Node(const Key& k, const Value& v, unsigned h): key(k), val(v), height(h), linked(false), born(UNBORN), died(LIVE){}
+    };
+
+    static constexpr unsigned MAX_LEVEL = 32;
+
+    static Node* makeNode(unsigned h);
+    static Node* makeNode(const Key& k, const Value& v, unsigned h);
+    static void destroyNode(Node* n) noexcept;
+    static void retireNode(void* n) noexcept;
+
+    static Node* ptr(uintptr_t link) noexcept { return reinterpret_cast<Node*>(link & ~uintptr_t(1)); }
+    static bool marked(uintptr_t link) noexcept { return (link & 1) != 0; }
+    static uintptr_t link(Node* n, bool mark = false) noexcept { return reinterpret_cast<uintptr_t>(n) | (mark ? 1 : 0); }
+
+    // Fix n's born / died version if its write has not yet, and return it.
+    // Whoever gets there first, the writer or a reader, settles it at the
+    // clock as it is then; see the class comment.
+    uint64_t settleBirth(Node* n) const noexcept;
+    uint64_t settleDeath(Node* n) const noexcept;
+    uint64_t clockNow() const noexcept;
+
+    bool alive(Node* n) const noexcept { return settleDeath(n) == LIVE; }
+    bool visibleAt(Node* n, uint64_t version) const noexcept {
+        return settleBirth(n) <= version && settleDeath(n) > version;
+    }
+
+    Node* head;
+    Node* tail;
+    std::atomic<size_t> sl_size;
+    std::atomic<unsigned> sl_height; // tallest tower ever linked
+    mutable EpochManager epochs;
+
+    // the version the next snapshot reads at, minus one; see the class comment
+    mutable std::atomic<uint64_t> clock;
+
+    // open snapshots' versions, and dead nodes kept for them
+    mutable std::mutex snapshot_lock;
+    mutable std::multiset<uint64_t> snapshot_versions;
+    mutable std::atomic<size_t> open_snapshots;
+    mutable std::vector<Node*> retained;
+
+public:
+	class Snapshot;
+
+	ConcurrentSkipList();
+
+	ConcurrentSkipList(const ConcurrentSkipList &) = delete;
+	ConcurrentSkipList & operator=(const ConcurrentSkipList &) = delete;
+
+	// No other thread may be using the list when it is destroyed.
+	~ConcurrentSkipList();
+
+	// How many distinct keys are in the skip list? Exact only when no
+	// writer is running.
+	size_t size() const noexcept;
+
+	bool isEmpty() const noexcept;
+
+	// Height of the tallest tower, plus the empty top layer, like SkipList.
+	unsigned numLayers() const noexcept;
+
+	// Throw a RuntimeException if this key is not in the list.
+	unsigned height(const Key & k) const;
+
+	// Does the list contain this key?
+	bool contains(const Key & k) const;
+
+	// A copy of the value mapped to k.
+	// Throw a RuntimeException if the key does not exist.
+	Value find(const Key & k) const;
+
+	// Same contract as SkipList::nextKey / previousKey.
+	Key nextKey(const Key & k) const;
+	Key previousKey(const Key & k) const;
+
+	// Non-throwing versions of find / nextKey / previousKey: empty on a miss.
+	std::optional<Value> tryFind(const Key & k) const;
+	std::optional<Key> tryNextKey(const Key & k) const;
+	std::optional<Key> tryPreviousKey(const Key & k) const;
+
+	// Return true if this key/value pair is inserted, false if the key was
+	// already present. Safe to call from any number of threads at once.
+	bool insert(const Key & k, const Value & v);
+
+	// Remove this key. Return true if this call removed it, false if it was
+	// not present (or another thread removed it first). The node is freed
+	// once no reader can still be looking at it. If the key is still being
+	// inserted by another thread, waits for that insert to finish linking.
+	bool erase(const Key & k);
+
+	// All keys in increasing order. Keys inserted while the walk runs may
+	// or may not be included.
+	std::vector<Key> allKeysInOrder() const;
+
+	// A consistent read-only view of the list as it is now; writers carry
+	// on meanwhile. See Snapshot.
+	Snapshot snapshot() const;
+
+private:
+    unsigned chooseHeight(const Key & k) const;
+
+    // Read-only descent: returns the first unmarked S_0 node whose key is
+    // not less than k (or tail) and stores its S_0 predecessor in pred.
+    Node* locate(const Key & k, Node *& pred) const;
+
+    // Writer descent: fills preds/succs for layers [0, top) and unlinks any
+    // marked node it passes. Returns true if succs[0] holds key k. With
+    // pastK, every node for k counts as before k, so the descent passes
+    // (and unlinks) all of them that are marked.
+    bool findSplice(const Key & k, Node ** preds, Node ** succs, unsigned top, bool pastK = false);
+
+    // Mark every layer of victim, which is dead and owned by the caller,
+    // unlink it and retire it.
+    void removeNode(Node* victim, EpochManager::Guard & g);
+
+    // Keep victim, which died at `version`, if an open snapshot is older.
+    bool retainForSnapshots(Node* victim, uint64_t version) const;
+
+    uint64_t openSnapshot() const;
+    void closeSnapshot(uint64_t version) const;
+
+public:
+	// Snapshot -- the list as of one version.
+	//
+	// Lookups and iteration see every key that was present at that version
+	// and nothing written after it. Keys and values can be returned by
+	// reference: nothing the snapshot can see is freed while it is open.
+	// Open snapshots keep the list from reclaiming memory, even memory they
+	// do not need, so close (destroy) them when the scan is done. A
+	// snapshot may be used from any thread, one at a time, and must be closed
+	// before the list is destroyed.
+	class Snapshot
+	{
+	public:
+		Snapshot(Snapshot && other) noexcept
+			: list(other.list), snap_version(other.snap_version), guard(std::move(other.guard)) { other.list = nullptr; }
+		Snapshot(const Snapshot &) = delete;
+		Snapshot & operator=(const Snapshot &) = delete;
+		~Snapshot() { if (list != nullptr) { list->closeSnapshot(snap_version); } }
+
+		// Walks the keys visible to the snapshot in increasing order.
+		class const_iterator
+		{
+		public:
+			const Key & key() const noexcept { return node->key; }
+			const Value & value() const noexcept { return node->val; }
+			const_iterator & operator++() noexcept { node = snap->nextVisible(ptr(node->next[0].load(std::memory_order_acquire))); return *this; }
+			bool operator==(const const_iterator & other) const noexcept { return node == other.node; }
+			bool operator!=(const const_iterator & other) const noexcept { return node != other.node; }
+
+		private:
+			friend class Snapshot;
+			const_iterator(const Snapshot* s, Node* n) noexcept : snap(s), node(n) {}
+
+			const Snapshot* snap;
+			Node* node;
+		};
+
+		// The version the snapshot reads at.
+		uint64_t version() const noexcept { return snap_version; }
+
+		bool contains(const Key & k) const { return tryFind(k) != nullptr; }
+
+		// The value for k, or nullptr if k was not present.
+		const Value * tryFind(const Key & k) const;
+
+		// Throw a RuntimeException if the key was not present.
+		const Value & find(const Key & k) const;
+
+		const_iterator begin() const noexcept { return const_iterator(this, nextVisible(ptr(list->head->next[0].load(std::memory_order_acquire)))); }
+		const_iterator end() const noexcept { return const_iterator(this, list->tail); }
+
+		// The first visible key not less than k, or end().
+		const_iterator lower_bound(const Key & k) const;
+
+		std::vector<Key> allKeysInOrder() const;
+
+	private:
+		friend class ConcurrentSkipList;
+		Snapshot(const ConcurrentSkipList* l, uint64_t v, EpochManager::Guard && g) noexcept
+			: list(l), snap_version(v), guard(std::move(g)) {}
+
+		// n, or the first node after it the snapshot can see (tail if none)
+		Node* nextVisible(Node* n) const noexcept;
+
+		const ConcurrentSkipList* list;
+		uint64_t snap_version;
+		EpochManager::Guard guard;
+	};
+
+private:
+};
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node* ConcurrentSkipList<Key, Value>::makeNode(unsigned h) {
+    void* mem = ::operator new(sizeof(Node) + (h - 1) * sizeof(std::atomic<uintptr_t>));
+    Node* n = new (mem) Node(h);
+    for (unsigned i = 1; i < h; i++) {
+        new (&n->next[i]) std::atomic<uintptr_t>();
+    }
+    for (unsigned i = 0; i < h; i++) {
+        n->next[i].store(0, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node* ConcurrentSkipList<Key, Value>::makeNode(const Key& k, const Value& v, unsigned h) {
+    void* mem = ::operator new(sizeof(Node) + (h - 1) * sizeof(std::atomic<uintptr_t>));
+    Node* n;
+    try {
+        n = new (mem) Node(k, v, h);
+    } catch (...) {
+        ::operator delete(mem);
+        throw;
+    }
+    for (unsigned i = 1; i < h; i++) {
+        new (&n->next[i]) std::atomic<uintptr_t>();
+    }
+    for (unsigned i = 0; i < h; i++) {
+        n->next[i].store(0, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+template<typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::destroyNode(Node* n) noexcept {
+    n->~Node();
+    ::operator delete(n);
+}
+
+template<typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::retireNode(void* n) noexcept {
+    destroyNode(static_cast<Node*>(n));
+}
+
+template<typename Key, typename Value>
+ConcurrentSkipList<Key, Value>::ConcurrentSkipList(): sl_size(0), sl_height(1), clock(0), open_snapshots(0) {
+    head = makeNode(MAX_LEVEL);
+    try {
+        tail = makeNode(1);
+    } catch (...) {
+        destroyNode(head);
+        throw;
+    }
+    for (unsigned i = 0; i < MAX_LEVEL; i++) {
+        head->next[i].store(link(tail), std::memory_order_relaxed);
+    }
+}
+
+template<typename Key, typename Value>
+ConcurrentSkipList<Key, Value>::~ConcurrentSkipList() {
+    // everything still on S_0 is ours, retained nodes included; unlinked
+    // nodes belong to epochs
+    Node* row = ptr(head->next[0].load(std::memory_order_relaxed));
+    while (row != tail) {
+        Node* del = row;
+        row = ptr(row->next[0].load(std::memory_order_relaxed));
+        destroyNode(del);
+    }
+    destroyNode(head);
+    destroyNode(tail);
+}
+
+template<typename Key, typename Value>
+size_t ConcurrentSkipList<Key, Value>::size() const noexcept {
+    return sl_size.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::isEmpty() const noexcept {
+    return size() == 0;
+}
+
+template<typename Key, typename Value>
+unsigned ConcurrentSkipList<Key, Value>::numLayers() const noexcept {
+    return sl_height.load(std::memory_order_relaxed) + 1;
+}
+
+template<typename Key, typename Value>
+unsigned ConcurrentSkipList<Key, Value>::chooseHeight(const Key & k) const {
+    unsigned max = layerCapFor(sl_size.load(std::memory_order_relaxed));
+    if (max > MAX_LEVEL) {
+        max = MAX_LEVEL;
+    }
+    unsigned h = 1;
+    while (h + 1 < max && flipCoin(k, h - 1)) {
+        h++;
+    }
+    return h;
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node* ConcurrentSkipList<Key, Value>::locate(const Key & k, Node *& pred) const {
+    Node* p = head;
+    Node* curr = tail;
+    for (unsigned layer = sl_height.load(std::memory_order_acquire); layer-- > 0;) {
+        curr = ptr(p->next[layer].load(std::memory_order_acquire));
+        while (curr != tail) {
+            uintptr_t succ = curr->next[layer].load(std::memory_order_acquire);
+            if (marked(succ)) {
+                // being removed, step over it without helping
+                curr = ptr(succ);
+            } else if (curr->key < k) {
+                p = curr;
+                curr = ptr(succ);
+            } else {
+                break;
+            }
+        }
+    }
+    pred = p;
+    return curr;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::findSplice(const Key & k, Node ** preds, Node ** succs, unsigned top, bool pastK) {
+retry:
+    Node* pred = head;
+    for (unsigned layer = top; layer-- > 0;) {
+        Node* curr = ptr(pred->next[layer].load(std::memory_order_acquire));
+        while (curr != tail) {
+            uintptr_t succ = curr->next[layer].load(std::memory_order_acquire);
+            if (marked(succ)) {
+                // help the remover: swing pred past curr, start over if pred moved
+                uintptr_t expected = link(curr);
+                if (!pred->next[layer].compare_exchange_strong(expected, link(ptr(succ)),
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    goto retry;
+                }
+                curr = ptr(succ);
+            } else if (curr->key < k || (pastK && curr->key == k)) {
+                pred = curr;
+                curr = ptr(succ);
+            } else {
+                break;
+            }
+        }
+        preds[layer] = pred;
+        succs[layer] = curr;
+    }
+    return succs[0] != tail && succs[0]->key == k;
+}
+
+template<typename Key, typename Value>
+unsigned ConcurrentSkipList<Key, Value>::height(const Key & k) const {
+    EpochManager::Guard g = epochs.pin();
+    Node* pred;
+    Node* n = locate(k, pred);
+    if (n != tail && n->key == k && alive(n)) {
+        return n->height;
+    }
+    throw RuntimeException("No key.");
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::contains(const Key & k) const {
+    EpochManager::Guard g = epochs.pin();
+    Node* pred;
+    Node* n = locate(k, pred);
+    return n != tail && n->key == k && alive(n);
+}
+
+template<typename Key, typename Value>
+std::optional<Value> ConcurrentSkipList<Key, Value>::tryFind(const Key & k) const {
+    EpochManager::Guard g = epochs.pin();
+    Node* pred;
+    Node* n = locate(k, pred);
+    if (n != tail && n->key == k && alive(n)) {
+        return n->val;
+    }
+    return std::nullopt;
+}
+
+template<typename Key, typename Value>
+std::optional<Key> ConcurrentSkipList<Key, Value>::tryNextKey(const Key & k) const {
+    EpochManager::Guard g = epochs.pin();
+    Node* pred;
+    Node* n = locate(k, pred);
+    if (n != tail && n->key == k && alive(n)) {
+        Node* succ = ptr(n->next[0].load(std::memory_order_acquire));
+        while (succ != tail && (marked(succ->next[0].load(std::memory_order_acquire)) || !alive(succ))) {
+            succ = ptr(succ->next[0].load(std::memory_order_acquire));
+        }
+        if (succ != tail) {
+            return succ->key;
+        }
+    }
+    return std::nullopt;
+}
+
+template<typename Key, typename Value>
+std::optional<Key> ConcurrentSkipList<Key, Value>::tryPreviousKey(const Key & k) const {
+    EpochManager::Guard g = epochs.pin();
+    Node* pred;
+    Node* n = locate(k, pred);
+    if (n == tail || !(n->key == k) || !alive(n)) {
+        return std::nullopt;
+    }
+    // pred may be a dead node kept for a snapshot. A newer, live node for
+    // the same key sits in front of it, so check all of that key's nodes
+    // before looking further back.
+    while (pred != head && !alive(pred)) {
+        Key key = pred->key;
+        Node* before;
+        Node* live = nullptr;
+        for (Node* v = locate(key, before); v != tail && v->key == key;
+                v = ptr(v->next[0].load(std::memory_order_acquire))) {
+            if (!marked(v->next[0].load(std::memory_order_acquire)) && alive(v)) {
+                live = v;
+                break;
+            }
+        }
+        pred = live != nullptr ? live : before;
+    }
+    if (pred != head) {
+        return pred->key;
+    }
+    return std::nullopt;
+}
+
+template<typename Key, typename Value>
+Value ConcurrentSkipList<Key, Value>::find(const Key & k) const {
+    std::optional<Value> v = tryFind(k);
+    if (!v) {
+        throw RuntimeException("find failed.");
+    }
+    return std::move(*v);
+}
+
+template<typename Key, typename Value>
+Key ConcurrentSkipList<Key, Value>::nextKey(const Key & k) const {
+    std::optional<Key> next = tryNextKey(k);
+    if (!next) {
+        throw RuntimeException("failed to get next key.");
+    }
+    return std::move(*next);
+}
+
+template<typename Key, typename Value>
+Key ConcurrentSkipList<Key, Value>::previousKey(const Key & k) const {
+    std::optional<Key> prev = tryPreviousKey(k);
+    if (!prev) {
+        throw RuntimeException("No previous key");
+    }
+    return std::move(*prev);
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::insert(const Key & k, const Value & v) {
+    unsigned h = chooseHeight(k);
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+
+    EpochManager::Guard g = epochs.pin();
+    unsigned top = sl_height.load(std::memory_order_acquire);
+    if (top < h) {
+        top = h;
+    }
+
+    Node* newNode = makeNode(k, v, h);
+    while (true) {
+        // alive settles the death of a dead node for k, so this node, which
+        // goes in front of it, is born no earlier
+        if (findSplice(k, preds, succs, top) && alive(succs[0])) {
+            // key exists in list, we cannot insert
+            destroyNode(newNode);
+            return false;
+        }
+        for (unsigned i = 0; i < h; i++) {
+            newNode->next[i].store(link(succs[i]), std::memory_order_relaxed);
+        }
+        // linking S_0 is what makes the key visible
+        uintptr_t expected = link(succs[0]);
+        if (preds[0]->next[0].compare_exchange_strong(expected, link(newNode),
+                std::memory_order_release, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    settleBirth(newNode);
+    sl_size.fetch_add(1, std::memory_order_relaxed);
+
+    unsigned seen = sl_height.load(std::memory_order_relaxed);
+    while (seen < h && !sl_height.compare_exchange_weak(seen, h, std::memory_order_release)) {}
+
+    // raise the tower one layer at a time; stop if someone starts removing it
+    for (unsigned i = 1; i < h; i++) {
+        while (true) {
+            uintptr_t mine = newNode->next[i].load(std::memory_order_acquire);
+            if (marked(mine)) {
+                newNode->linked.store(true, std::memory_order_release);
+                return true;
+            }
+            if (ptr(mine) != succs[i] &&
+                !newNode->next[i].compare_exchange_strong(mine, link(succs[i]), std::memory_order_acq_rel)) {
+                continue;
+            }
+            uintptr_t expected = link(succs[i]);
+            if (preds[i]->next[i].compare_exchange_strong(expected, link(newNode),
+                    std::memory_order_release, std::memory_order_relaxed)) {
+                break;
+            }
+            findSplice(k, preds, succs, top);
+            if (succs[0] != newNode) {
+                // already removed again
+                newNode->linked.store(true, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    newNode->linked.store(true, std::memory_order_release);
+    return true;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::erase(const Key & k) {
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+
+    EpochManager::Guard g = epochs.pin();
+    unsigned top = sl_height.load(std::memory_order_acquire);
+    if (!findSplice(k, preds, succs, top) || !alive(succs[0])) {
+        return false;
+    }
+    Node* victim = succs[0];
+
+    // whoever marks it dying owns the removal
+    uint64_t expected = LIVE;
+    if (!victim->died.compare_exchange_strong(expected, DYING, std::memory_order_acq_rel)) {
+        return false;
+    }
+    uint64_t version = settleDeath(victim);
+    sl_size.fetch_sub(1, std::memory_order_relaxed);
+
+    if (open_snapshots.load(std::memory_order_seq_cst) == 0 || !retainForSnapshots(victim, version)) {
+        removeNode(victim, g);
+    }
+    return true;
+}
+
+template<typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::removeNode(Node* victim, EpochManager::Guard & g) {
+    // mark the upper layers top-down so the tower stops being raised
+    for (unsigned i = victim->height; i-- > 0;) {
+        uintptr_t succ = victim->next[i].load(std::memory_order_acquire);
+        while (!marked(succ) &&
+               !victim->next[i].compare_exchange_weak(succ, succ | 1, std::memory_order_acq_rel)) {}
+    }
+
+    while (!victim->linked.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    // a writer descent unlinks every marked node it passes, on every layer;
+    // newer nodes for the same key may sit in front of victim
+    Node* preds[MAX_LEVEL];
+    Node* succs[MAX_LEVEL];
+    unsigned top = sl_height.load(std::memory_order_acquire);
+    findSplice(victim->key, preds, succs, victim->height > top ? victim->height : top, true);
+    g.retire(victim, &retireNode);
+}
+
+template<typename Key, typename Value>
+uint64_t ConcurrentSkipList<Key, Value>::clockNow() const noexcept {
+    // pairs with the fence in openSnapshot: reading the clock from before
+    // a snapshot advanced it means the write this settles (made before
+    // the fence) is visible to that snapshot's reads (made after its fence)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return clock.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+uint64_t ConcurrentSkipList<Key, Value>::settleBirth(Node* n) const noexcept {
+    uint64_t born = n->born.load(std::memory_order_acquire);
+    if (born == UNBORN) {
+        uint64_t now = clockNow();
+        born = n->born.compare_exchange_strong(born, now, std::memory_order_acq_rel) ? now : born;
+    }
+    return born;
+}
+
+template<typename Key, typename Value>
+uint64_t ConcurrentSkipList<Key, Value>::settleDeath(Node* n) const noexcept {
+    uint64_t died = n->died.load(std::memory_order_acquire);
+    if (died == DYING) {
+        // a node never dies before it is born
+        settleBirth(n);
+        uint64_t now = clockNow();
+        died = n->died.compare_exchange_strong(died, now, std::memory_order_acq_rel) ? now : died;
+    }
+    return died;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentSkipList<Key, Value>::retainForSnapshots(Node* victim, uint64_t version) const {
+    std::lock_guard<std::mutex> lock(snapshot_lock);
+    if (snapshot_versions.empty() || *snapshot_versions.begin() >= version) {
+        return false;
+    }
+    retained.push_back(victim);
+    return true;
+}
+
+template<typename Key, typename Value>
+uint64_t ConcurrentSkipList<Key, Value>::openSnapshot() const {
+    std::lock_guard<std::mutex> lock(snapshot_lock);
+    // counted before the clock moves: an erase that then finds no snapshot
+    // open settled its death no later than this version, so is not needed
+    open_snapshots.fetch_add(1, std::memory_order_seq_cst);
+    uint64_t version = clock.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    snapshot_versions.insert(version);
+    return version;
+}
+
+template<typename Key, typename Value>
+void ConcurrentSkipList<Key, Value>::closeSnapshot(uint64_t version) const {
+    std::vector<Node*> expired;
+    {
+        std::lock_guard<std::mutex> lock(snapshot_lock);
+        snapshot_versions.erase(snapshot_versions.find(version));
+        open_snapshots.fetch_sub(1, std::memory_order_seq_cst);
+        uint64_t oldest = snapshot_versions.empty() ? LIVE : *snapshot_versions.begin();
+        size_t kept = 0;
+        for (Node* n : retained) {
+            if (n->died.load(std::memory_order_relaxed) <= oldest) {
+                expired.push_back(n);
+            } else {
+                retained[kept++] = n;
+            }
+        }
+        retained.resize(kept);
+    }
+    if (!expired.empty()) {
+        // unlinking writes to the list, like any other writer
+        ConcurrentSkipList* self = const_cast<ConcurrentSkipList*>(this);
+        EpochManager::Guard g = epochs.pin();
+        for (Node* n : expired) {
+            self->removeNode(n, g);
+        }
+    }
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Snapshot ConcurrentSkipList<Key, Value>::snapshot() const {
+    EpochManager::Guard g = epochs.pin();
+    uint64_t version = openSnapshot();
+    return Snapshot(this, version, std::move(g));
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Node* ConcurrentSkipList<Key, Value>::Snapshot::nextVisible(Node* n) const noexcept {
+    while (n != list->tail && !list->visibleAt(n, snap_version)) {
+        n = ptr(n->next[0].load(std::memory_order_acquire));
+    }
+    return n;
+}
+
+template<typename Key, typename Value>
+typename ConcurrentSkipList<Key, Value>::Snapshot::const_iterator ConcurrentSkipList<Key, Value>::Snapshot::lower_bound(const Key & k) const {
+    Node* pred;
+    return const_iterator(this, nextVisible(list->locate(k, pred)));
+}
+
+template<typename Key, typename Value>
+const Value * ConcurrentSkipList<Key, Value>::Snapshot::tryFind(const Key & k) const {
+    // the versions of k sit newest first; the first one old enough decides
+    Node* pred;
+    for (Node* n = list->locate(k, pred); n != list->tail && n->key == k;
+            n = ptr(n->next[0].load(std::memory_order_acquire))) {
+        if (list->settleBirth(n) <= snap_version) {
+            return list->visibleAt(n, snap_version) ? &n->val : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Value>
+const Value & ConcurrentSkipList<Key, Value>::Snapshot::find(const Key & k) const {
+    const Value* v = tryFind(k);
+    if (v == nullptr) {
+        throw RuntimeException("find failed.");
+    }
+    return *v;
+}
+
+template<typename Key, typename Value>
+std::vector<Key> ConcurrentSkipList<Key, Value>::Snapshot::allKeysInOrder() const {
+    std::vector<Key> v;
+    for (const_iterator it = begin(); it != end(); ++it) {
+        v.push_back(it.key());
+    }
+    return v;
+}
+
+template<typename Key, typename Value>
+std::vector<Key> ConcurrentSkipList<Key, Value>::allKeysInOrder() const {
+    EpochManager::Guard g = epochs.pin();
+    std::vector<Key> v;
+    Node* temp = ptr(head->next[0].load(std::memory_order_acquire));
+    while (temp != tail) {
+        uintptr_t succ = temp->next[0].load(std::memory_order_acquire);
+        if (!marked(succ) && alive(temp)) {
+            v.push_back(temp->key);
+        }
+        temp = ptr(succ);
+    }
+    return v;
+}
+
+#endif
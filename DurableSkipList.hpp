@@ -0,0 +1,724 @@
+#ifndef ___DURABLE_SKIP_LIST_HPP
+#define ___DURABLE_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SkipList.hpp"
+#include "SnapshotFormat.hpp"
+#include "runtimeexcept.hpp"
+
+// How a WriteAheadLog makes appended records durable.
+//
+//   Commit    a write returns once its record is on disk. Writers that
+//             arrive while one of them is syncing wait for the next sync
+//             and share it (group commit), so a busy log costs one fsync
+//             per batch, not per write.
+//   Interval  a write returns once its record is buffered; a background
+//             thread writes out and syncs the log every `interval`, and a
+//             write that fills the buffer writes it out. A crash loses at
+//             most about `interval` of writes.
+//   None      records are written out when the buffer fills and synced
+//             only by sync(), rotation and destruction.
+enum class WalSync { Commit, Interval, None };
+
+struct WalOptions
+{
+	WalSync sync = WalSync::Commit;
+	std::chrono::milliseconds interval{10};
+	// buffered bytes that trigger a write-out (Interval and None)
+	size_t bufferBytes = size_t(1) << 20;
+};
+
+// WriteAheadLog -- an append-only log of opaque records with group commit.
+//
+// A log file starts with WAL_MAGIC and holds records framed as a uint32_t
+// payload length, a uint32_t checksum of the payload, then the payload.
+// readAll returns the payloads up to the first incomplete or corrupt
+// record, which is where a crash mid-write leaves a log.
+//
+// append may be called from any number of threads and hands back the
+// record's sequence number; commit then waits as the WalSync mode says.
+// Records reach the file in append order.
+//
+// If writing or syncing fails, every record not yet synced is lost: the file may end in a torn
+// record, which is where a replay stops, so nothing more is written to it.
+// commit (and sync) throw for a lost record from then on, including when
+// it was appended before the failure but not written yet. rotate() starts
+// a good file again.
+class WriteAheadLog
+{
+public:
+	static constexpr char WAL_MAGIC[8] = {'S', 'K', 'I', 'P', 'W', 'A', 'L', '1'};
+
+	// Create (or truncate) the log at path. Throw a RuntimeException if it
+	// cannot be created.
+	WriteAheadLog(const std::string & path, const WalOptions & options);
+
+	WriteAheadLog(const WriteAheadLog &) = delete;
+	WriteAheadLog & operator=(const WriteAheadLog &) = delete;
+
+	// Writes out and syncs whatever is buffered, and stops the Interval sync
+	// thread. Nothing may be appending.
+	~WriteAheadLog();
+
+	uint64_t append(const std::string & payload);
+
+	// Wait until record seq is as durable as the options ask for.
+	// Throw a RuntimeException if it is lost (see above).
+	void commit(uint64_t seq);
+
+	// Everything appended so far is on disk once this returns. Throw a
+	// RuntimeException if any of it is lost.
+	void sync();
+
+	// Sync the current file, then continue in a new one at path. If the
+	// current file has failed, the records it lost stay lost (their commits
+	// keep throwing) and only the new file is written from here on. Throw
+	// a RuntimeException if the new file cannot be created.
+	void rotate(const std::string & path);
+
+	// The payloads stored in the log at path, in order.
+	static std::vector<std::string> readAll(const std::string & path);
+
+	static uint32_t checksum(const char* data, size_t n) noexcept;
+
+private:
+	static int create(const std::string & path);
+
+	// Write out (and with durable, sync) everything up to seq. Only one
+	// thread does the I/O at a time; the others wait for it and find their
+	// records went out in the same batch.
+	void flush(std::unique_lock<std::mutex> & l, uint64_t seq, bool durable);
+
+	// Has record seq been lost to a failed write?
+	bool lost(uint64_t seq) const noexcept;
+
+	// the Interval mode's background sync
+	void syncLoop();
+
+	WalOptions options;
+	int fd;
+	std::mutex lock;
+	std::condition_variable done;
+	std::string pending;   // framed records not yet written
+	uint64_t appended;     // sequence number of the last append
+	uint64_t written;      // ... of the last record written out
+	uint64_t synced;       // ... of the last record synced
+	bool busy;             // a thread is doing I/O
+	bool failed;           // the file has failed; nothing more goes to it
+	// records lost to failed files: [first, last] ranges, the last range
+	// open-ended while `failed`
+	std::vector<std::pair<uint64_t, uint64_t>> lost_ranges;
+	bool stopping;         // the sync thread should exit
+	std::condition_variable tick;
+	std::thread syncer;
+};
+
+inline WriteAheadLog::WriteAheadLog(const std::string & path, const WalOptions & options)
+	: options(options), fd(create(path)), appended(0), written(0), synced(0), busy(false),
+	  failed(false), stopping(false)
+{
+	if (options.sync == WalSync::Interval) {
+		syncer = std::thread([this]() { syncLoop(); });
+	}
+}
+
+inline WriteAheadLog::~WriteAheadLog()
+{
+	if (syncer.joinable()) {
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stopping = true;
+		}
+		tick.notify_all();
+		syncer.join();
+	}
+	try {
+		sync();
+	} catch (...) {
+		// nothing sensible to do about a failed sync while being destroyed
+	}
+	::close(fd);
+}
+
+inline void WriteAheadLog::syncLoop()
+{
+	std::unique_lock<std::mutex> l(lock);
+	while (!stopping) {
+		tick.wait_for(l, options.interval);
+		if (stopping || failed || synced == appended) {
+			continue;
+		}
+		try {
+			flush(l, appended, true);
+		} catch (...) {
+			// the failure is recorded; commits of the lost records report it
+		}
+	}
+}
+
+inline bool WriteAheadLog::lost(uint64_t seq) const noexcept
+{
+	if (failed && seq >= lost_ranges.back().first) {
+		return true;
+	}
+	for (const auto & range : lost_ranges) {
+		if (seq >= range.first && seq <= range.second) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline int WriteAheadLog::create(const std::string & path)
+{
+	int f = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (f < 0) {
+		throw RuntimeException("WriteAheadLog: cannot create " + path + ".");
+	}
+	if (::write(f, WAL_MAGIC, sizeof(WAL_MAGIC)) != static_cast<ssize_t>(sizeof(WAL_MAGIC)) || ::fdatasync(f) != 0) {
+		::close(f);
+		throw RuntimeException("WriteAheadLog: cannot write " + path + ".");
+	}
+	return f;
+}
+
+inline uint32_t WriteAheadLog::checksum(const char* data, size_t n) noexcept
+{
+	// FNV-1a: enough to tell a torn or garbled tail from a real record
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < n; i++) {
+		h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+	}
+	return h;
+}
+
+inline uint64_t WriteAheadLog::append(const std::string & payload)
+{
+	uint32_t header[2] = {static_cast<uint32_t>(payload.size()), checksum(payload.data(), payload.size())};
+	std::lock_guard<std::mutex> l(lock);
+	if (!failed) {
+		// nothing more goes to a failed file
+		pending.append(reinterpret_cast<const char*>(header), sizeof(header));
+		pending.append(payload);
+	}
+	return ++appended;
+}
+
+inline void WriteAheadLog::commit(uint64_t seq)
+{
+	std::unique_lock<std::mutex> l(lock);
+	switch (options.sync) {
+	case WalSync::Commit:
+		flush(l, seq, true);
+		break;
+	case WalSync::Interval:
+	case WalSync::None:
+		if (lost(seq)) {
+			throw RuntimeException("WriteAheadLog: record lost to a failed write.");
+		}
+		if (pending.size() >= options.bufferBytes) {
+			flush(l, appended, false);
+		}
+		break;
+	}
+}
+
+inline void WriteAheadLog::sync()
+{
+	std::unique_lock<std::mutex> l(lock);
+	flush(l, appended, true);
+}
+
+inline void WriteAheadLog::rotate(const std::string & path)
+{
+	std::unique_lock<std::mutex> l(lock);
+	try {
+		flush(l, appended, true);
+	} catch (const RuntimeException &) {
+		// recorded as lost; the new file is what matters now
+	}
+	// keep other threads' I/O off the descriptor while it changes
+	while (busy) {
+		done.wait(l);
+	}
+	int next = create(path);
+	::close(fd);
+	fd = next;
+	if (failed) {
+		// everything appended since the failure is lost too
+		lost_ranges.back().second = appended;
+		written = synced = appended;
+		failed = false;
+	}
+}
+
+inline void WriteAheadLog::flush(std::unique_lock<std::mutex> & l, uint64_t seq, bool durable)
+{
+	for (;;) {
+		// a lost record can look settled once rotation has moved on
+		if (lost(seq)) {
+			throw RuntimeException("WriteAheadLog: record lost to a failed write.");
+		}
+		if (durable ? synced >= seq : written >= seq) {
+			break;
+		}
+		if (busy) {
+			done.wait(l);
+			continue;
+		}
+		// lead this batch: take everything buffered, do the I/O unlocked
+		busy = true;
+		std::string batch;
+		batch.swap(pending);
+		uint64_t upto = appended;
+		l.unlock();
+		bool ok = true;
+		for (size_t off = 0; ok && off < batch.size();) {
+			ssize_t n = ::write(fd, batch.data() + off, batch.size() - off);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			ok = n > 0;
+			off += ok ? static_cast<size_t>(n) : 0;
+		}
+		if (ok && durable) {
+			ok = ::fdatasync(fd) == 0;
+		}
+		l.lock();
+		busy = false;
+		if (ok) {
+			written = upto;
+			if (durable) {
+				synced = upto;
+			}
+		} else {
+			// the batch may be half written and what was written but not
+			// synced may be gone: every record past the last sync is lost,
+			// and waiters for them find out from lost()
+			failed = true;
+			lost_ranges.emplace_back(synced + 1, synced);
+			pending.clear();
+		}
+		done.notify_all();
+	}
+}
+
+inline std::vector<std::string> WriteAheadLog::readAll(const std::string & path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw RuntimeException("WriteAheadLog: cannot open " + path + ".");
+	}
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (bytes.size() < sizeof(WAL_MAGIC) || std::memcmp(bytes.data(), WAL_MAGIC, sizeof(WAL_MAGIC)) != 0) {
+		throw RuntimeException("WriteAheadLog: " + path + " is not a log.");
+	}
+	std::vector<std::string> records;
+	size_t off = sizeof(WAL_MAGIC);
+	uint32_t header[2];
+	while (bytes.size() - off >= sizeof(header)) {
+		std::memcpy(header, bytes.data() + off, sizeof(header));
+		off += sizeof(header);
+		if (header[0] > bytes.size() - off || checksum(bytes.data() + off, header[0]) != header[1]) {
+			break;
+		}
+		records.emplace_back(bytes, off, header[0]);
+		off += header[0];
+	}
+	return records;
+}
+
+
+// The files of a store kept in a directory are named prefix-N.suffix,
+// with N zero-padded so that names sort in number order.
+inline std::string storeFile(const std::string & dir, const char* prefix, uint64_t n, const char* suffix)
+{
+	char num[24];
+	std::snprintf(num, sizeof(num), "%020llu", static_cast<unsigned long long>(n));
+	return dir + "/" + prefix + num + suffix;
+}
+
+// The numbers N of the files named prefix-N.suffix in dir, ascending.
+// Throw a RuntimeException if dir cannot be read.
+inline std::vector<uint64_t> storeFiles(const std::string & dir, const char* prefix, const char* suffix)
+{
+	std::vector<uint64_t> found;
+	DIR* d = ::opendir(dir.c_str());
+	if (d == nullptr) {
+		throw RuntimeException("cannot read " + dir + ".");
+	}
+	size_t pre = std::strlen(prefix), suf = std::strlen(suffix);
+	while (dirent* e = ::readdir(d)) {
+		std::string name = e->d_name;
+		if (name.size() == pre + 20 + suf && name.compare(0, pre, prefix) == 0 &&
+				name.compare(pre + 20, suf, suffix) == 0) {
+			found.push_back(std::stoull(name.substr(pre, 20)));
+		}
+	}
+	::closedir(d);
+	std::sort(found.begin(), found.end());
+	return found;
+}
+
+// fsync a file or directory; new and renamed files only survive a crash
+// once their directory has been synced too.
+inline bool syncPath(const std::string & path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = ::fsync(fd) == 0;
+	::close(fd);
+	return ok;
+}
+
+
+// WalRecord -- the log records of a key-value store: a put of a key and
+// value, or an erase of a key, encoded with SnapshotCodec. Replaying a
+// record says what its key ends up as, so replaying one twice is harmless.
+template<typename Key, typename Value>
+struct WalRecord
+{
+	enum Op : uint8_t { PUT = 1, ERASE = 2 };
+
+	static std::string put(const Key & k, const Value & v)
+	{
+		std::ostringstream out;
+		out.put(static_cast<char>(PUT));
+		SnapshotCodec<Key>::write(out, k);
+		SnapshotCodec<Value>::write(out, v);
+		return out.str();
+	}
+
+	static std::string erase(const Key & k)
+	{
+		std::ostringstream out;
+		out.put(static_cast<char>(ERASE));
+		SnapshotCodec<Key>::write(out, k);
+		return out.str();
+	}
+
+	// Call onPut(const Key &, Value &&) or onErase(const Key &) for record.
+	// Throw a RuntimeException if it is neither.
+	template<typename OnPut, typename OnErase>
+	static void replay(const std::string & record, OnPut && onPut, OnErase && onErase)
+	{
+		std::istringstream in(record);
+		int op = in.get();
+		Key k = SnapshotCodec<Key>::read(in);
+		if (op == PUT) {
+			onPut(k, SnapshotCodec<Value>::read(in));
+		} else if (op == ERASE) {
+			onErase(k);
+		} else {
+			throw RuntimeException("WalRecord: unknown log record.");
+		}
+	}
+};
+
+
+// DurableSkipList -- a SkipList whose writes survive a restart.
+//
+// The list lives in a directory. Every successful insert, assign and erase
+// is appended to a write-ahead log (see WriteAheadLog and WalSync) before
+// it is applied; checkpoint() saves the whole list in the binary snapshot
+// format and starts a fresh log, after which the older log and checkpoint
+// files are deleted. Opening the directory loads the newest checkpoint and
+// replays the logs written since, in order. So the files on disk are
+//
+//     checkpoint-N.snap   the list as of the start of log N
+//     wal-N.log, ...      the writes since, oldest first
+//
+// A checkpoint never holds writers out for long: it copies the list
+// CHECKPOINT_CHUNK keys at a time under the shared lock, letting writers
+// in between chunks, then saves the copy with no lock held. So each key
+// is copied as of some moment after the new log started, and replaying
+// that log over the copy brings every key up to date: each record says
+// what its key ends up as, so replaying a write the copy already holds
+// changes nothing.
+//
+// Readers share a lock and writers take it exclusively. Values come back as
+// copies, since a reference would outlive the lock; read() runs a function
+// over the list itself under the shared lock, for scans. Key and Value must
+// be trivially copyable or std::string, as for snapshots.
+template<typename Key, typename Value,
+         typename Alloc = std::allocator<std::pair<const Key, Value>>,
+         typename LevelGen = FlipCoinLevels>
+class DurableSkipList
+{
+public:
+	using List = SkipList<Key, Value, Alloc, LevelGen>;
+
+	// Open the list stored in dir, creating dir if needed. Throw a
+	// RuntimeException if it cannot be read or created.
+	explicit DurableSkipList(const std::string & dir, const WalOptions & options = WalOptions(),
+	                         const Alloc & alloc = Alloc());
+
+	DurableSkipList(const DurableSkipList &) = delete;
+	DurableSkipList & operator=(const DurableSkipList &) = delete;
+
+	size_t size() const;
+	bool isEmpty() const;
+
+	bool contains(const Key & k) const;
+	Value find(const Key & k) const;
+	std::optional<Value> tryFind(const Key & k) const;
+
+	// Same results as SkipList's; a write that changes nothing is not
+	// logged. If the log fails they throw a RuntimeException with the
+	// write already in the list: it is durable again after a checkpoint.
+	bool insert(const Key & k, const Value & v);
+	bool insert_or_assign(const Key & k, const Value & v);
+	bool erase(const Key & k);
+
+	// Call f(const List &) under the shared lock.
+	template<typename F>
+	auto read(F && f) const;
+
+	// Make every write so far durable, whatever the WalSync mode.
+	void sync();
+
+	// Save the list and drop the logs it makes redundant.
+	void checkpoint();
+
+private:
+	using Record = WalRecord<Key, Value>;
+
+	// log a write under the exclusive lock, then wait for it outside
+	template<typename Apply>
+	bool write(Apply && apply);
+
+	// keys a checkpoint copies per turn of the shared lock
+	static constexpr size_t CHECKPOINT_CHUNK = 4096;
+
+	std::string dir;
+	List list;
+	mutable std::shared_mutex list_lock;
+	std::unique_ptr<WriteAheadLog> wal;
+	uint64_t segment; // number of the log being written
+	std::mutex checkpoint_lock;
+};
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+DurableSkipList<Key, Value, Alloc, LevelGen>::DurableSkipList(const std::string & dir, const WalOptions & options, const Alloc & alloc)
+	: dir(dir), list(alloc), segment(0)
+{
+	if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+		throw RuntimeException("DurableSkipList: cannot create " + dir + ".");
+	}
+	std::vector<uint64_t> checkpoints = storeFiles(dir, "checkpoint-", ".snap");
+	uint64_t base = 0;
+	if (!checkpoints.empty()) {
+		base = checkpoints.back();
+		std::ifstream in(storeFile(dir, "checkpoint-", base, ".snap"), std::ios::binary);
+		list.load(in);
+	}
+	for (uint64_t n : storeFiles(dir, "wal-", ".log")) {
+		segment = std::max(segment, n);
+		if (n >= base) {
+			for (const std::string & record : WriteAheadLog::readAll(storeFile(dir, "wal-", n, ".log"))) {
+				Record::replay(record,
+				               [this](const Key & k, Value && v) { list.insert_or_assign(k, std::move(v)); },
+				               [this](const Key & k) { list.erase(k); });
+			}
+		}
+	}
+	// a log cut short by a crash is only ever replayed, never appended to
+	segment = std::max(segment, base) + 1;
+	wal = std::make_unique<WriteAheadLog>(storeFile(dir, "wal-", segment, ".log"), options);
+	syncPath(dir);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+size_t DurableSkipList<Key, Value, Alloc, LevelGen>::size() const
+{
+	std::shared_lock<std::shared_mutex> l(list_lock);
+	return list.size();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::isEmpty() const
+{
+	return size() == 0;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::contains(const Key & k) const
+{
+	std::shared_lock<std::shared_mutex> l(list_lock);
+	return list.contains(k);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+Value DurableSkipList<Key, Value, Alloc, LevelGen>::find(const Key & k) const
+{
+	std::shared_lock<std::shared_mutex> l(list_lock);
+	return list.find(k);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+std::optional<Value> DurableSkipList<Key, Value, Alloc, LevelGen>::tryFind(const Key & k) const
+{
+	std::shared_lock<std::shared_mutex> l(list_lock);
+	const Value* v = list.tryFind(k);
+	if (v == nullptr) {
+		return std::nullopt;
+	}
+	return *v;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+template<typename Apply>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::write(Apply && apply)
+{
+	uint64_t seq;
+	{
+		std::unique_lock<std::shared_mutex> l(list_lock);
+		// apply returns the record to log, or nothing if the write is a
+		// no-op; it logs before it changes the list
+		std::optional<uint64_t> logged = apply();
+		if (!logged) {
+			return false;
+		}
+		seq = *logged;
+	}
+	// waiting here, unlocked, is what lets later writers join the batch
+	wal->commit(seq);
+	return true;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::insert(const Key & k, const Value & v)
+{
+	return write([&]() -> std::optional<uint64_t> {
+		if (list.contains(k)) {
+			return std::nullopt;
+		}
+		uint64_t seq = wal->append(Record::put(k, v));
+		list.insert(k, v);
+		return seq;
+	});
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::insert_or_assign(const Key & k, const Value & v)
+{
+	bool inserted = false;
+	write([&]() -> std::optional<uint64_t> {
+		uint64_t seq = wal->append(Record::put(k, v));
+		inserted = list.insert_or_assign(k, v).second;
+		return seq;
+	});
+	return inserted;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool DurableSkipList<Key, Value, Alloc, LevelGen>::erase(const Key & k)
+{
+	return write([&]() -> std::optional<uint64_t> {
+		if (!list.contains(k)) {
+			return std::nullopt;
+		}
+		uint64_t seq = wal->append(Record::erase(k));
+		list.erase(k);
+		return seq;
+	});
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+template<typename F>
+auto DurableSkipList<Key, Value, Alloc, LevelGen>::read(F && f) const
+{
+	std::shared_lock<std::shared_mutex> l(list_lock);
+	return f(static_cast<const List &>(list));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+void DurableSkipList<Key, Value, Alloc, LevelGen>::sync()
+{
+	wal->sync();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+void DurableSkipList<Key, Value, Alloc, LevelGen>::checkpoint()
+{
+	std::lock_guard<std::mutex> one(checkpoint_lock);
+	uint64_t next;
+	{
+		// writes from here on go to the new log
+		std::unique_lock<std::shared_mutex> l(list_lock);
+		next = segment + 1;
+		wal->rotate(storeFile(dir, "wal-", next, ".log"));
+		segment = next;
+	}
+	syncPath(dir);
+
+	// copy the list a chunk at a time, each chunk picking up after the
+	// last key of the one before
+	std::vector<std::pair<Key, Value>> items;
+	for (bool more = true; more;) {
+		std::shared_lock<std::shared_mutex> l(list_lock);
+		auto it = items.empty() ? list.begin() : list.upper_bound(items.back().first);
+		for (size_t i = 0; i < CHECKPOINT_CHUNK && it != list.end(); i++, ++it) {
+			items.emplace_back(it->first, it->second);
+		}
+		more = it != list.end();
+	}
+	// the snapshot format does not depend on the allocator or the heights
+	SkipList<Key, Value> copy;
+	copy.assignSorted(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+	items = std::vector<std::pair<Key, Value>>();
+
+	std::string tmp = storeFile(dir, "checkpoint-", next, ".tmp");
+	{
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		copy.save(out);
+		out.close();
+		if (!out) {
+			std::remove(tmp.c_str());
+			throw RuntimeException("DurableSkipList: cannot write " + tmp + ".");
+		}
+	}
+	bool synced = syncPath(tmp);
+	std::string final = storeFile(dir, "checkpoint-", next, ".snap");
+	if (!synced || std::rename(tmp.c_str(), final.c_str()) != 0) {
+		std::remove(tmp.c_str());
+		throw RuntimeException("DurableSkipList: cannot write " + final + ".");
+	}
+	syncPath(dir);
+
+	// only now is everything before log `next` redundant
+	for (uint64_t n : storeFiles(dir, "checkpoint-", ".snap")) {
+		if (n < next) {
+			std::remove(storeFile(dir, "checkpoint-", n, ".snap").c_str());
+		}
+	}
+	for (uint64_t n : storeFiles(dir, "wal-", ".log")) {
+		if (n < next) {
+			std::remove(storeFile(dir, "wal-", n, ".log").c_str());
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef __LEVEL_GENERATORS_HPP
+#define __LEVEL_GENERATORS_HPP
+
+#include <cstdint>
+#include <functional>
+
+// Level generators decide how tall a new tower is. SkipList calls
+//
+//     unsigned operator()(const Key & k, unsigned layers, unsigned maxLayers)
+//
+// with the current number of layers and the cap insert enforces, and
+// expects a height in [1, maxLayers - 1]. The default, FlipCoinLevels
+// (see SkipList.hpp), keeps the original flipCoin behaviour; the
+// generators here give a geometric distribution with promotion
+// probability p no matter what the keys look like.
+
+// Commonly used promotion probabilities. 1/e minimises the expected
+// number of comparisons per search, 1/4 trades a few comparisons for
+// shorter towers (fewer links per key).
+constexpr double LEVEL_P_HALF = 0.5;
+constexpr double LEVEL_P_QUARTER = 0.25;
+constexpr double LEVEL_P_INV_E = 0.36787944117144233;
+
+// Turns a stream of uniformly random 64-bit words into a geometric height.
+class GeometricLevels
+{
+public:
+	explicit GeometricLevels(double p)
+		: bits_per_flip(0), threshold(0)
+	{
+		if (p == LEVEL_P_HALF) {
+			bits_per_flip = 1;
+		} else if (p == LEVEL_P_QUARTER) {
+			bits_per_flip = 2;
+		} else {
+			// heads when the top 32 bits are below p * 2^32
+			double t = p * 4294967296.0;
+			threshold = t <= 0 ? 0 : (t >= 4294967295.0 ? 4294967295u : static_cast<uint32_t>(t));
+		}
+	}
+
+protected:
+	template<typename Source>
+	unsigned draw(Source next, unsigned maxLayers) const
+	{
+		unsigned cap = maxLayers > 1 ? maxLayers - 1 : 1;
+		unsigned h = 1;
+		if (bits_per_flip != 0) {
+			// p = 2^-bits: each flip is heads when its bits are all zero
+			uint64_t mask = (uint64_t(1) << bits_per_flip) - 1;
+			uint64_t r = next();
+			unsigned left = 64 / bits_per_flip;
+			while (h < cap && (r & mask) == 0) {
+				h++;
+				r >>= bits_per_flip;
+				if (--left == 0) {
+					r = next();
+					left = 64 / bits_per_flip;
+				}
+			}
+		} else {
+			while (h < cap && static_cast<uint32_t>(next() >> 32) < threshold) {
+				h++;
+			}
+		}
+		return h;
+	}
+
+private:
+	unsigned bits_per_flip;
+	uint32_t threshold;
+};
+
+// XorShiftLevels -- random heights from an xorshift64* generator.
+// Independent of the keys, so no key pattern can skew the towers. The
+// default seed makes runs reproducible; pass your own for variety.
+class XorShiftLevels : public GeometricLevels
+{
+public:
+	explicit XorShiftLevels(double p = LEVEL_P_HALF, uint64_t seed = 0x9E3779B97F4A7C15ull)
+		: GeometricLevels(p), state(seed == 0 ? 1 : seed) {}
+
+	template<typename Key>
+	unsigned operator()(const Key &, unsigned, unsigned maxLayers)
+	{
+		return draw([this]() { return nextWord(); }, maxLayers);
+	}
+
+private:
+	uint64_t nextWord() noexcept
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1Dull;
+	}
+
+	uint64_t state;
+};
+
+// HashLevels -- heights derived from a well-mixed hash of the key.
+// Still deterministic (a key always gets the same height, which makes
+// runs reproducible), but keys that share byte patterns no longer end up
+// with the same height. The seed lets different lists disagree.
+template<template<typename> class Hash = std::hash>
+class HashLevels : public GeometricLevels
+{
+public:
+	explicit HashLevels(double p = LEVEL_P_HALF, uint64_t seed = 0)
+		: GeometricLevels(p), seed(seed) {}
+
+	template<typename Key>
+	unsigned operator()(const Key & k, unsigned, unsigned maxLayers) const
+	{
+		uint64_t x = static_cast<uint64_t>(Hash<Key>{}(k)) ^ seed;
+		return draw([&x]() { return splitMix(x); }, maxLayers);
+	}
+
+private:
+	// splitmix64: a full-avalanche finaliser, so std::hash values that are
+	// just the identity (as for integers) still come out uniform
+	static uint64_t splitMix(uint64_t & x) noexcept
+	{
+		uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	uint64_t seed;
+};
+
+#endif
@@ -0,0 +1,660 @@
+#ifndef ___MEMTABLE_SKIP_LIST_HPP
+#define ___MEMTABLE_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SkipList.hpp"
+#include "DurableSkipList.hpp"
+#include "SnapshotFormat.hpp"
+#include "runtimeexcept.hpp"
+
+struct MemtableOptions
+{
+	// freeze the list taking writes once it uses this many bytes: its
+	// bytesUsed(), plus the heap memory of its values
+	size_t memtableBytes = size_t(4) << 20;
+	// target size of the data blocks of a sorted run
+	size_t blockBytes = 4096;
+	// at most this many frozen memtables wait to be flushed; see
+	// MemtableSkipList for what a writer does when there are that many
+	size_t maxFrozen = 4;
+	WalOptions wal;
+};
+
+// SortedRun -- an immutable file of keys in increasing order, each with a
+// value or a mark that it was erased.
+//
+// The file is RUN_MAGIC, then the data blocks, then the sparse index and a
+// footer. A block is a sequence of entries (a flag byte, the key, and the
+// value unless the flag says erased), cut once it reaches the block size.
+// The index holds the first key and offset of each block and is loaded
+// when the run is opened; a lookup reads the one block that can hold its
+// key. Entries are encoded with SnapshotCodec, so Key and Value must be
+// trivially copyable or std::string.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class SortedRun
+{
+public:
+	static constexpr char RUN_MAGIC[8] = {'S', 'K', 'I', 'P', 'R', 'U', 'N', '1'};
+
+	// Write the entries of [first, last), pairs of a key and a
+	// std::optional<Value> that is empty for an erased key, in increasing
+	// key order, to path, and sync it. Throw a RuntimeException on failure.
+	template<typename It>
+	static void write(const std::string & path, It first, It last, size_t blockBytes);
+
+	// Open the run at path. Throw a RuntimeException if it is not one.
+	explicit SortedRun(const std::string & path, const Compare & comp = Compare());
+
+	SortedRun(const SortedRun &) = delete;
+	SortedRun & operator=(const SortedRun &) = delete;
+
+	~SortedRun();
+
+	// How many entries, erased keys included, are in the run?
+	size_t size() const noexcept { return count; }
+
+	// Does the run hold an entry for k? If so, v is set to its value, or to
+	// nullopt if the entry says k was erased.
+	bool lookup(const Key & k, std::optional<Value> & v) const;
+
+private:
+	std::string readAt(uint64_t offset, uint64_t n) const;
+
+	std::string path;
+	int fd;
+	uint64_t count;
+	std::vector<Key> firstKeys;    // of each block
+	std::vector<uint64_t> offsets; // of each block, then of the index
+	Compare less;
+};
+
+template<typename Key, typename Value, typename Compare>
+template<typename It>
+void SortedRun<Key, Value, Compare>::write(const std::string & path, It first, It last, size_t blockBytes)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(RUN_MAGIC, sizeof(RUN_MAGIC));
+	std::vector<Key> keys;
+	std::vector<uint64_t> starts;
+	uint64_t offset = sizeof(RUN_MAGIC), count = 0;
+	std::ostringstream block;
+	auto cut = [&]() {
+		std::string bytes = block.str();
+		out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		offset += bytes.size();
+		block.str(std::string());
+	};
+	for (; first != last; ++first) {
+		const auto & entry = *first;
+		if (block.tellp() == 0) {
+			keys.push_back(entry.first);
+			starts.push_back(offset);
+		}
+		block.put(entry.second ? 1 : 0);
+		SnapshotCodec<Key>::write(block, entry.first);
+		if (entry.second) {
+			SnapshotCodec<Value>::write(block, *entry.second);
+		}
+		count++;
+		if (static_cast<size_t>(block.tellp()) >= blockBytes) {
+			cut();
+		}
+	}
+	if (block.tellp() != 0) {
+		cut();
+	}
+	uint64_t index = offset, blocks = keys.size();
+	SnapshotCodec<uint64_t>::write(out, count);
+	SnapshotCodec<uint64_t>::write(out, blocks);
+	for (size_t i = 0; i < keys.size(); i++) {
+		SnapshotCodec<Key>::write(out, keys[i]);
+		SnapshotCodec<uint64_t>::write(out, starts[i]);
+	}
+	SnapshotCodec<uint64_t>::write(out, index);
+	out.write(RUN_MAGIC, sizeof(RUN_MAGIC));
+	out.close();
+	if (!out || !syncPath(path)) {
+		std::remove(path.c_str());
+		throw RuntimeException("SortedRun: cannot write " + path + ".");
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+SortedRun<Key, Value, Compare>::SortedRun(const std::string & path, const Compare & comp)
+	: path(path), fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)), count(0), less(comp)
+{
+	if (fd < 0) {
+		throw RuntimeException("SortedRun: cannot open " + path + ".");
+	}
+	try {
+		struct stat st;
+		const uint64_t footer = sizeof(uint64_t) + sizeof(RUN_MAGIC);
+		if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(RUN_MAGIC) + footer) {
+			throw RuntimeException("SortedRun: " + path + " is not a run.");
+		}
+		uint64_t length = static_cast<uint64_t>(st.st_size);
+		std::string tail = readAt(length - footer, footer);
+		uint64_t index;
+		std::memcpy(&index, tail.data(), sizeof(index));
+		if (std::memcmp(tail.data() + sizeof(index), RUN_MAGIC, sizeof(RUN_MAGIC)) != 0 ||
+				readAt(0, sizeof(RUN_MAGIC)) != std::string(RUN_MAGIC, sizeof(RUN_MAGIC)) ||
+				index < sizeof(RUN_MAGIC) || index > length - footer) {
+			throw RuntimeException("SortedRun: " + path + " is not a run.");
+		}
+		std::istringstream in(readAt(index, length - footer - index));
+		count = SnapshotCodec<uint64_t>::read(in);
+		uint64_t blocks = SnapshotCodec<uint64_t>::read(in);
+		for (uint64_t i = 0; i < blocks; i++) {
+			firstKeys.push_back(SnapshotCodec<Key>::read(in));
+			offsets.push_back(SnapshotCodec<uint64_t>::read(in));
+			if (offsets.back() < (i == 0 ? sizeof(RUN_MAGIC) : offsets[i - 1] + 1) || offsets.back() >= index) {
+				throw RuntimeException("SortedRun: " + path + " has a corrupt index.");
+			}
+		}
+		offsets.push_back(index);
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+SortedRun<Key, Value, Compare>::~SortedRun()
+{
+	::close(fd);
+}
+
+template<typename Key, typename Value, typename Compare>
+std::string SortedRun<Key, Value, Compare>::readAt(uint64_t offset, uint64_t n) const
+{
+	std::string bytes(n, '\0');
+	size_t done = 0;
+	while (done < n) {
+		ssize_t got = ::pread(fd, &bytes[done], n - done, static_cast<off_t>(offset + done));
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			throw RuntimeException("SortedRun: cannot read " + path + ".");
+		}
+		done += static_cast<size_t>(got);
+	}
+	return bytes;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool SortedRun<Key, Value, Compare>::lookup(const Key & k, std::optional<Value> & v) const
+{
+	// the last block whose first key is not greater than k
+	auto it = std::upper_bound(firstKeys.begin(), firstKeys.end(), k, less);
+	if (it == firstKeys.begin()) {
+		return false;
+	}
+	size_t b = static_cast<size_t>(it - firstKeys.begin()) - 1;
+	std::istringstream in(readAt(offsets[b], offsets[b + 1] - offsets[b]));
+	while (in.peek() != std::char_traits<char>::eof()) {
+		bool live = in.get() != 0;
+		Key key = SnapshotCodec<Key>::read(in);
+		std::optional<Value> value;
+		if (live) {
+			value = SnapshotCodec<Value>::read(in);
+		}
+		if (less(k, key)) {
+			return false;
+		}
+		if (!less(key, k)) {
+			v = std::move(value);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// MemtableSkipList -- a key-value store on disk, written through an
+// in-memory SkipList (the memtable) that is flushed to sorted runs.
+//
+// Writes go to the active memtable and its write-ahead log. Once the
+// memtable holds about options.memtableBytes, it is frozen: it takes no
+// more writes and a fresh memtable with a fresh log takes its place. The
+// fresh one is built ahead of time by the flush thread (or, if it is not
+// ready, by the one writer that needs it, with no lock held), so a freeze
+// only swaps pointers. The flush thread writes each frozen memtable,
+// oldest first, to a SortedRun file and then deletes its log; a failed
+// flush is retried, waiting twice as long after each failure in a row, up
+// to a second.
+//
+// Memory stays bounded: while options.maxFrozen memtables wait to be
+// flushed, a writer that finds the active memtable full waits for a flush
+// to finish, or throws the last flush's exception if that flush failed,
+// without applying its write. Writers only wait when flushing cannot keep
+// up with them.
+//
+// Lookups try the active memtable, then the frozen ones from newest to
+// oldest, then the runs from newest to oldest, and stop at the first that
+// knows the key, so an erase is stored as an entry saying the key is gone.
+// The files in the directory are
+//
+//     run-N.sst     memtable N, flushed
+//     wal-N.log     the log of memtable N, while it is not yet flushed
+//
+// and opening the directory replays the logs into the new active memtable.
+// Runs are never merged: each flush adds one, and a lookup for a key that
+// is nowhere reads one block of every run.
+//
+// Writes are blind: insert_or_assign and erase do not check whether the key
+// is already there, which would mean searching the runs. Values come back
+// as copies. All members may be called from any number of threads. Key and
+// Value must be trivially copyable or std::string.
+template<typename Key, typename Value, typename LevelGen = FlipCoinLevels>
+class MemtableSkipList
+{
+public:
+	using Run = SortedRun<Key, Value>;
+
+	// Open the store in dir, creating dir if needed, and start the flush
+	// thread. Throw a RuntimeException if it cannot be read or created.
+	explicit MemtableSkipList(const std::string & dir, const MemtableOptions & options = MemtableOptions());
+
+	MemtableSkipList(const MemtableSkipList &) = delete;
+	MemtableSkipList & operator=(const MemtableSkipList &) = delete;
+
+	// Stop the flush thread once it finishes the run it is writing. Frozen
+	// memtables not yet flushed are still in their logs for the next open.
+	~MemtableSkipList();
+
+	void insert_or_assign(const Key & k, const Value & v);
+	void erase(const Key & k);
+
+	bool contains(const Key & k) const;
+	std::optional<Value> tryFind(const Key & k) const;
+
+	// The value for k. Throw a RuntimeException if it does not exist.
+	Value find(const Key & k) const;
+
+	// Freeze the active memtable and wait until every frozen memtable is a
+	// run. Throw a RuntimeException if a flush fails meanwhile; the flush
+	// thread keeps retrying, and the memtables stay in memory until then.
+	void flush();
+
+	// How many memtables are waiting to be flushed, and how many runs are
+	// there?
+	size_t frozenCount() const;
+	size_t runCount() const;
+
+private:
+	struct Memtable
+	{
+		Memtable(uint64_t id, std::unique_ptr<WriteAheadLog> wal) : id(id), valueHeap(0), wal(std::move(wal)) {}
+
+		// Store v for k, keeping count of the heap memory values own,
+		// which the list itself does not track.
+		void set(const Key & k, std::optional<Value> v)
+		{
+			if (const std::optional<Value>* old = list.tryFind(k); old != nullptr && *old) {
+				valueHeap -= SkipListHeapBytes<Value>::of(**old);
+			}
+			if (v) {
+				valueHeap += SkipListHeapBytes<Value>::of(*v);
+			}
+			list.insert_or_assign(k, std::move(v));
+		}
+
+		size_t bytes() const noexcept { return list.bytesUsed() + valueHeap; }
+
+		// an empty value says the key is erased
+		SkipList<Key, std::optional<Value>, std::allocator<std::pair<const Key, std::optional<Value>>>, LevelGen> list;
+		uint64_t id;
+		size_t valueHeap;
+		std::unique_ptr<WriteAheadLog> wal;
+	};
+
+	using Record = WalRecord<Key, Value>;
+
+	// a memtable with a new log; creates a file, so call it unlocked
+	std::shared_ptr<Memtable> newMemtable(uint64_t id);
+	void put(const Key & k, std::optional<Value> v, const std::string & record);
+
+	// Call with state_lock held exclusively by l. prepareSpare makes sure
+	// there is a spare memtable, building one with l released if needed;
+	// freeze makes the spare the active memtable.
+	void prepareSpare(std::unique_lock<std::shared_mutex> & l);
+	void freeze(std::unique_lock<std::shared_mutex> & l);
+
+	void flushLoop();
+
+	// Where k is known, the first place a lookup finds it: its value, or
+	// nullopt if it is erased. nullopt if it is nowhere.
+	std::optional<std::optional<Value>> lookup(const Key & k) const;
+
+	std::string dir;
+	MemtableOptions options;
+	mutable std::shared_mutex state_lock; // guards everything below
+	std::shared_ptr<Memtable> active;
+	std::shared_ptr<Memtable> spare;               // the next active one
+	bool preparing;                                // a thread builds spare
+	std::deque<std::shared_ptr<Memtable>> frozen;  // oldest first
+	std::vector<std::shared_ptr<const Run>> runs;  // newest first
+	uint64_t next_id;
+	bool stopping;
+	std::exception_ptr flush_error; // of the last flush, if it failed
+	size_t flush_failures;
+	std::condition_variable_any work;     // a freeze used the spare, or stopping
+	std::condition_variable_any flushed;  // a flush finished or failed
+	std::condition_variable_any prepared; // preparing went back to false
+	std::thread flusher;
+};
+
+template<typename Key, typename Value, typename LevelGen>
+MemtableSkipList<Key, Value, LevelGen>::MemtableSkipList(const std::string & dir, const MemtableOptions & options)
+	: dir(dir), options(options), preparing(false), next_id(1), stopping(false), flush_failures(0)
+{
+	if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+		throw RuntimeException("MemtableSkipList: cannot create " + dir + ".");
+	}
+	for (uint64_t n : storeFiles(dir, "run-", ".tmp")) {
+		std::remove(storeFile(dir, "run-", n, ".tmp").c_str());
+	}
+	std::vector<uint64_t> runIds = storeFiles(dir, "run-", ".sst");
+	std::vector<uint64_t> logIds = storeFiles(dir, "wal-", ".log");
+	for (auto n = runIds.rbegin(); n != runIds.rend(); ++n) {
+		runs.push_back(std::make_shared<const Run>(storeFile(dir, "run-", *n, ".sst")));
+		next_id = std::max(next_id, *n + 1);
+	}
+	for (uint64_t n : logIds) {
+		next_id = std::max(next_id, n + 1);
+	}
+
+	// Everything the old logs hold is newer than every run (a log is only
+	// deleted once its run exists), so it all goes into the new memtable,
+	// and into its log before the old ones are deleted.
+	active = newMemtable(next_id++);
+	uint64_t last = 0;
+	for (uint64_t n : logIds) {
+		for (const std::string & record : WriteAheadLog::readAll(storeFile(dir, "wal-", n, ".log"))) {
+			last = active->wal->append(record);
+			Record::replay(record,
+			               [this](const Key & k, Value && v) { active->set(k, std::move(v)); },
+			               [this](const Key & k) { active->set(k, std::nullopt); });
+		}
+	}
+	if (last != 0) {
+		active->wal->sync();
+	}
+	syncPath(dir);
+	for (uint64_t n : logIds) {
+		std::remove(storeFile(dir, "wal-", n, ".log").c_str());
+	}
+	if (active->bytes() >= options.memtableBytes) {
+		std::unique_lock<std::shared_mutex> l(state_lock);
+		freeze(l);
+	}
+	flusher = std::thread([this]() { flushLoop(); });
+}
+
+template<typename Key, typename Value, typename LevelGen>
+MemtableSkipList<Key, Value, LevelGen>::~MemtableSkipList()
+{
+	{
+		std::unique_lock<std::shared_mutex> l(state_lock);
+		stopping = true;
+	}
+	work.notify_all();
+	flusher.join();
+}
+
+template<typename Key, typename Value, typename LevelGen>
+std::shared_ptr<typename MemtableSkipList<Key, Value, LevelGen>::Memtable> MemtableSkipList<Key, Value, LevelGen>::newMemtable(uint64_t id)
+{
+	return std::make_shared<Memtable>(id, std::make_unique<WriteAheadLog>(storeFile(dir, "wal-", id, ".log"), options.wal));
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::prepareSpare(std::unique_lock<std::shared_mutex> & l)
+{
+	while (!spare) {
+		if (preparing) {
+			prepared.wait(l);
+			continue;
+		}
+		// the id is taken now so that memtables freeze in id order
+		preparing = true;
+		uint64_t id = next_id++;
+		l.unlock();
+		std::shared_ptr<Memtable> table;
+		std::exception_ptr error;
+		try {
+			table = newMemtable(id);
+		} catch (...) {
+			error = std::current_exception();
+		}
+		l.lock();
+		preparing = false;
+		prepared.notify_all();
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		spare = std::move(table);
+	}
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::freeze(std::unique_lock<std::shared_mutex> & l)
+{
+	prepareSpare(l);
+	frozen.push_back(std::move(active));
+	active = std::move(spare);
+	// the flush thread builds the next spare
+	work.notify_all();
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::put(const Key & k, std::optional<Value> v, const std::string & record)
+{
+	uint64_t seq;
+	std::shared_ptr<Memtable> table;
+	{
+		std::unique_lock<std::shared_mutex> l(state_lock);
+		while (active->bytes() >= options.memtableBytes) {
+			if (frozen.size() >= options.maxFrozen) {
+				if (flush_error) {
+					std::rethrow_exception(flush_error);
+				}
+				flushed.wait(l);
+			} else if (spare || !preparing) {
+				// only waits on the disk if the flush thread has not
+				// built the spare yet, and then with the lock released
+				freeze(l);
+			} else {
+				// another writer is building the spare; go over the
+				// budget a little rather than wait for it
+				break;
+			}
+		}
+		seq = active->wal->append(record);
+		active->set(k, std::move(v));
+		table = active;
+	}
+	// the memtable may freeze and even be flushed meanwhile; holding it
+	// keeps its log open until the commit is done
+	table->wal->commit(seq);
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::insert_or_assign(const Key & k, const Value & v)
+{
+	put(k, v, Record::put(k, v));
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::erase(const Key & k)
+{
+	put(k, std::nullopt, Record::erase(k));
+}
+
+template<typename Key, typename Value, typename LevelGen>
+std::optional<std::optional<Value>> MemtableSkipList<Key, Value, LevelGen>::lookup(const Key & k) const
+{
+	std::vector<std::shared_ptr<const Run>> search;
+	{
+		std::shared_lock<std::shared_mutex> l(state_lock);
+		if (const std::optional<Value>* v = active->list.tryFind(k)) {
+			return *v;
+		}
+		for (auto t = frozen.rbegin(); t != frozen.rend(); ++t) {
+			if (const std::optional<Value>* v = (*t)->list.tryFind(k)) {
+				return *v;
+			}
+		}
+		// read the runs unlocked, so writers do not wait on the disk
+		search = runs;
+	}
+	std::optional<Value> v;
+	for (const std::shared_ptr<const Run> & run : search) {
+		if (run->lookup(k, v)) {
+			return v;
+		}
+	}
+	return std::nullopt;
+}
+
+template<typename Key, typename Value, typename LevelGen>
+bool MemtableSkipList<Key, Value, LevelGen>::contains(const Key & k) const
+{
+	return tryFind(k).has_value();
+}
+
+template<typename Key, typename Value, typename LevelGen>
+std::optional<Value> MemtableSkipList<Key, Value, LevelGen>::tryFind(const Key & k) const
+{
+	std::optional<std::optional<Value>> found = lookup(k);
+	if (!found) {
+		return std::nullopt;
+	}
+	return *found;
+}
+
+template<typename Key, typename Value, typename LevelGen>
+Value MemtableSkipList<Key, Value, LevelGen>::find(const Key & k) const
+{
+	std::optional<Value> v = tryFind(k);
+	if (!v) {
+		throw RuntimeException("find failed.");
+	}
+	return *v;
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::flush()
+{
+	std::unique_lock<std::shared_mutex> l(state_lock);
+	if (!active->list.isEmpty()) {
+		freeze(l);
+	}
+	if (frozen.empty()) {
+		return;
+	}
+	uint64_t newest = frozen.back()->id;
+	size_t failures = flush_failures;
+	flushed.wait(l, [&]() { return flush_failures != failures || frozen.empty() || frozen.front()->id > newest; });
+	if (flush_failures != failures) {
+		std::rethrow_exception(flush_error);
+	}
+}
+
+template<typename Key, typename Value, typename LevelGen>
+size_t MemtableSkipList<Key, Value, LevelGen>::frozenCount() const
+{
+	std::shared_lock<std::shared_mutex> l(state_lock);
+	return frozen.size();
+}
+
+template<typename Key, typename Value, typename LevelGen>
+size_t MemtableSkipList<Key, Value, LevelGen>::runCount() const
+{
+	std::shared_lock<std::shared_mutex> l(state_lock);
+	return runs.size();
+}
+
+template<typename Key, typename Value, typename LevelGen>
+void MemtableSkipList<Key, Value, LevelGen>::flushLoop()
+{
+	const std::chrono::milliseconds firstBackoff(10), maxBackoff(1000);
+	std::chrono::milliseconds backoff = firstBackoff;
+	std::unique_lock<std::shared_mutex> l(state_lock);
+	for (;;) {
+		work.wait(l, [this]() { return stopping || !frozen.empty() || (!spare && !preparing); });
+		if (stopping) {
+			return;
+		}
+		if (!spare && !preparing) {
+			try {
+				prepareSpare(l);
+			} catch (...) {
+				// a writer that needs the spare builds it and sees the error
+				work.wait_for(l, backoff, [this]() { return stopping; });
+				backoff = std::min(backoff * 2, maxBackoff);
+			}
+			continue;
+		}
+		// frozen memtables are never written, so they can be read unlocked
+		std::shared_ptr<Memtable> table = frozen.front();
+		l.unlock();
+		std::shared_ptr<const Run> run;
+		try {
+			std::string tmp = storeFile(dir, "run-", table->id, ".tmp");
+			std::string path = storeFile(dir, "run-", table->id, ".sst");
+			Run::write(tmp, table->list.begin(), table->list.end(), options.blockBytes);
+			if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+				std::remove(tmp.c_str());
+				throw RuntimeException("MemtableSkipList: cannot write " + path + ".");
+			}
+			syncPath(dir);
+			run = std::make_shared<const Run>(path);
+		} catch (...) {
+			l.lock();
+			flush_error = std::current_exception();
+			flush_failures++;
+			flushed.notify_all();
+			work.wait_for(l, backoff, [this]() { return stopping; });
+			backoff = std::min(backoff * 2, maxBackoff);
+			continue;
+		}
+		backoff = firstBackoff;
+		l.lock();
+		runs.insert(runs.begin(), std::move(run));
+		frozen.pop_front();
+		flush_error = nullptr;
+		flushed.notify_all();
+		// closing the log syncs it, so do that and delete it unlocked; the
+		// run holds everything the log did
+		l.unlock();
+		uint64_t id = table->id;
+		table.reset();
+		std::remove(storeFile(dir, "wal-", id, ".log").c_str());
+		l.lock();
+	}
+}
+
+#endif
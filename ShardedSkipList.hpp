@@ -0,0 +1,482 @@
+#ifndef ___SHARDED_SKIP_LIST_HPP
+#define ___SHARDED_SKIP_LIST_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "SkipList.hpp"
+#include "runtimeexcept.hpp"
+
+// ShardedSkipList -- range-partitions keys over independent SkipLists.
+//
+// Shard i holds the keys in [bound(i - 1), bound(i)), so a point operation
+// touches exactly one shard and takes only that shard's lock: writers to
+// different shards never contend, and readers of a shard share its lock.
+// Scans visit the shards in key order, so they come out sorted.
+//
+// Finding the shard takes the layout lock shared, and that lock is split
+// into stripes on separate cache lines, one per group of threads, so
+// readers on different threads do not bounce a common line; rebalance
+// takes every stripe.
+//
+// Every write bumps its shard's write counter. rebalance() (called by hand
+// or automatically on a background thread, see setAutoRebalance) moves
+// about half of a shard that took far more than its share of writes into
+// its colder neighbour, shifting the boundary between them, so a hot
+// range gets spread out over time.
+//
+// All shards draw from copies of one allocator, which therefore has to be
+// safe to use from several threads at once (std::allocator is, a shared
+// ArenaAllocator is not).
+template<typename Key, typename Value,
+         typename Alloc = std::allocator<std::pair<const Key, Value>>,
+         typename LevelGen = FlipCoinLevels>
+class ShardedSkipList
+{
+private:
+	using List = SkipList<Key, Value, Alloc, LevelGen>;
+
+	struct alignas(64) Shard
+	{
+		explicit Shard(const Alloc & alloc) : list(alloc), writes(0) {}
+
+		mutable std::shared_mutex lock;
+		List list;
+		std::atomic<size_t> writes; // since the last rebalance
+	};
+
+	// A shared mutex split into STRIPES cache lines. lock_shared locks the
+	// calling thread's stripe; lock locks them all, in order.
+	class LayoutLock
+	{
+	public:
+		void lock()
+		{
+			for (Stripe & s : stripes) {
+				s.m.lock();
+			}
+		}
+		void unlock()
+		{
+			for (size_t i = STRIPES; i-- > 0;) {
+				stripes[i].m.unlock();
+			}
+		}
+		void lock_shared() { stripes[mine()].m.lock_shared(); }
+		void unlock_shared() { stripes[mine()].m.unlock_shared(); }
+
+	private:
+		static constexpr size_t STRIPES = 16;
+
+		// threads take stripes round-robin as they first show up
+		static size_t mine() noexcept
+		{
+			static std::atomic<size_t> next{0};
+			thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+			return stripe;
+		}
+
+		struct alignas(64) Stripe
+		{
+			std::shared_mutex m;
+		};
+		Stripe stripes[STRIPES];
+	};
+
+public:
+	// One shard per range between consecutive split points, so
+	// splitPoints.size() + 1 shards. Throw a RuntimeException if the
+	// split points are not strictly increasing.
+	explicit ShardedSkipList(std::vector<Key> splitPoints, const Alloc & alloc = Alloc());
+
+	// shardCount shards whose boundaries are the quantiles of a sample of
+	// the expected keys (in any order, repeats allowed). With too few
+	// distinct sampled keys there are fewer shards. Throw a
+	// RuntimeException if shardCount is 0.
+	template<typename InputIt>
+	ShardedSkipList(size_t shardCount, InputIt sampleFirst, InputIt sampleLast, const Alloc & alloc = Alloc());
+
+	ShardedSkipList(const ShardedSkipList &) = delete;
+	ShardedSkipList & operator=(const ShardedSkipList &) = delete;
+
+	// Stops the background rebalancer, if one was started.
+	~ShardedSkipList();
+
+	// How many keys are stored? Exact only when no writer is running.
+	size_t size() const;
+	bool isEmpty() const;
+
+	size_t shardCount() const;
+
+	// The first key of each shard but the first, in order.
+	std::vector<Key> splitPoints() const;
+
+	// Keys held by each shard, in order.
+	std::vector<size_t> shardSizes() const;
+
+	// Same contracts as SkipList; the value comes back as a copy, since a
+	// reference would outlive the shard's lock.
+	bool contains(const Key & k) const;
+	Value find(const Key & k) const;
+	std::optional<Value> tryFind(const Key & k) const;
+
+	bool insert(const Key & k, const Value & v);
+	bool erase(const Key & k);
+
+	// Call f(key, value) for every key in [lo, hi), in increasing order.
+	// Each shard is locked for reading while it is visited, so f must not
+	// write to this ShardedSkipList.
+	template<typename F>
+	void forEachInRange(const Key & lo, const Key & hi, F && f) const;
+
+	// All keys in increasing order.
+	std::vector<Key> allKeysInOrder() const;
+
+	// If some shard took more than twice the average number of writes since
+	// the last rebalance, move about the half of it next to its colder
+	// neighbour into that neighbour (the new boundary is the shard's
+	// SkipList::middle(), O(log n) expected). Return true if anything
+	// moved. Blocks every other operation while it runs, which costs a
+	// split and a merge, both linear in the keys of the two shards.
+	bool rebalance();
+
+	// Run rebalance() after every `writes` successful writes, on a
+	// background thread started by the first call, so no writer runs it;
+	// 0 (the default) turns it off.
+	void setAutoRebalance(size_t writes);
+
+private:
+	// index of the shard that holds k; call with layout held
+	size_t shardFor(const Key & k) const;
+
+	// count a write towards the automatic rebalance
+	void noteWrite();
+
+	// the background rebalancer
+	void rebalanceLoop();
+
+	Alloc alloc;
+	// bounds[i] is the first key of shard i + 1
+	std::vector<Key> bounds;
+	std::vector<std::unique_ptr<Shard>> shards;
+	// shared by every operation, exclusive while rebalance changes the layout
+	mutable LayoutLock layout;
+
+	std::atomic<size_t> auto_every;
+	std::atomic<size_t> writes_since_check;
+
+	std::mutex rebalancer_lock;
+	std::condition_variable rebalancer_wake;
+	bool rebalance_due = false;
+	bool stopping = false;
+	std::thread rebalancer;
+};
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+ShardedSkipList<Key, Value, Alloc, LevelGen>::ShardedSkipList(std::vector<Key> splitPoints, const Alloc & alloc)
+	: alloc(alloc), bounds(std::move(splitPoints)), auto_every(0), writes_since_check(0)
+{
+	for (size_t i = 1; i < bounds.size(); i++) {
+		if (!(bounds[i - 1] < bounds[i])) {
+			throw RuntimeException("ShardedSkipList: split points must be strictly increasing.");
+		}
+	}
+	for (size_t i = 0; i <= bounds.size(); i++) {
+		shards.push_back(std::make_unique<Shard>(alloc));
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+template<typename InputIt>
+ShardedSkipList<Key, Value, Alloc, LevelGen>::ShardedSkipList(size_t shardCount, InputIt sampleFirst, InputIt sampleLast, const Alloc & alloc)
+	: alloc(alloc), auto_every(0), writes_since_check(0)
+{
+	if (shardCount == 0) {
+		throw RuntimeException("ShardedSkipList: need at least one shard.");
+	}
+	std::vector<Key> sample(sampleFirst, sampleLast);
+	std::sort(sample.begin(), sample.end());
+	// cut at every (i / shardCount)-quantile; a repeat of the previous cut
+	// would make an empty range, so it is skipped
+	for (size_t i = 1; i < shardCount && !sample.empty(); i++) {
+		const Key & q = sample[i * sample.size() / shardCount];
+		if (bounds.empty() ? sample.front() < q : bounds.back() < q) {
+			bounds.push_back(q);
+		}
+	}
+	for (size_t i = 0; i <= bounds.size(); i++) {
+		shards.push_back(std::make_unique<Shard>(alloc));
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+ShardedSkipList<Key, Value, Alloc, LevelGen>::~ShardedSkipList()
+{
+	{
+		std::lock_guard<std::mutex> l(rebalancer_lock);
+		stopping = true;
+	}
+	rebalancer_wake.notify_all();
+	if (rebalancer.joinable()) {
+		rebalancer.join();
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+size_t ShardedSkipList<Key, Value, Alloc, LevelGen>::shardFor(const Key & k) const
+{
+	return static_cast<size_t>(std::upper_bound(bounds.begin(), bounds.end(), k) - bounds.begin());
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+size_t ShardedSkipList<Key, Value, Alloc, LevelGen>::size() const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	size_t n = 0;
+	for (const auto & s : shards) {
+		std::shared_lock<std::shared_mutex> sl(s->lock);
+		n += s->list.size();
+	}
+	return n;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool ShardedSkipList<Key, Value, Alloc, LevelGen>::isEmpty() const
+{
+	return size() == 0;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+size_t ShardedSkipList<Key, Value, Alloc, LevelGen>::shardCount() const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	return shards.size();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+std::vector<Key> ShardedSkipList<Key, Value, Alloc, LevelGen>::splitPoints() const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	return bounds;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+std::vector<size_t> ShardedSkipList<Key, Value, Alloc, LevelGen>::shardSizes() const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	std::vector<size_t> sizes;
+	for (const auto & s : shards) {
+		std::shared_lock<std::shared_mutex> sl(s->lock);
+		sizes.push_back(s->list.size());
+	}
+	return sizes;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool ShardedSkipList<Key, Value, Alloc, LevelGen>::contains(const Key & k) const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	const Shard & s = *shards[shardFor(k)];
+	std::shared_lock<std::shared_mutex> sl(s.lock);
+	return s.list.contains(k);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+Value ShardedSkipList<Key, Value, Alloc, LevelGen>::find(const Key & k) const
+{
+	std::optional<Value> v = tryFind(k);
+	if (!v) {
+		throw RuntimeException("find failed.");
+	}
+	return *std::move(v);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+std::optional<Value> ShardedSkipList<Key, Value, Alloc, LevelGen>::tryFind(const Key & k) const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	const Shard & s = *shards[shardFor(k)];
+	std::shared_lock<std::shared_mutex> sl(s.lock);
+	const Value* v = s.list.tryFind(k);
+	if (v == nullptr) {
+		return std::nullopt;
+	}
+	return *v;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool ShardedSkipList<Key, Value, Alloc, LevelGen>::insert(const Key & k, const Value & v)
+{
+	bool inserted;
+	{
+		std::shared_lock<LayoutLock> l(layout);
+		Shard & s = *shards[shardFor(k)];
+		std::unique_lock<std::shared_mutex> sl(s.lock);
+		inserted = s.list.insert(k, v);
+		if (inserted) {
+			s.writes.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	// the rebalancer needs the layout lock exclusively: wake it after letting go
+	if (inserted) {
+		noteWrite();
+	}
+	return inserted;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool ShardedSkipList<Key, Value, Alloc, LevelGen>::erase(const Key & k)
+{
+	bool erased;
+	{
+		std::shared_lock<LayoutLock> l(layout);
+		Shard & s = *shards[shardFor(k)];
+		std::unique_lock<std::shared_mutex> sl(s.lock);
+		erased = s.list.erase(k);
+		if (erased) {
+			s.writes.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	if (erased) {
+		noteWrite();
+	}
+	return erased;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+void ShardedSkipList<Key, Value, Alloc, LevelGen>::noteWrite()
+{
+	size_t every = auto_every.load(std::memory_order_relaxed);
+	if (every != 0 && writes_since_check.fetch_add(1, std::memory_order_relaxed) + 1 >= every) {
+		writes_since_check.store(0, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> l(rebalancer_lock);
+			rebalance_due = true;
+		}
+		rebalancer_wake.notify_one();
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+void ShardedSkipList<Key, Value, Alloc, LevelGen>::rebalanceLoop()
+{
+	std::unique_lock<std::mutex> l(rebalancer_lock);
+	for (;;) {
+		rebalancer_wake.wait(l, [this]() { return rebalance_due || stopping; });
+		if (stopping) {
+			return;
+		}
+		rebalance_due = false;
+		l.unlock();
+		rebalance();
+		l.lock();
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+template<typename F>
+void ShardedSkipList<Key, Value, Alloc, LevelGen>::forEachInRange(const Key & lo, const Key & hi, F && f) const
+{
+	if (!(lo < hi)) {
+		return;
+	}
+	std::shared_lock<LayoutLock> l(layout);
+	for (size_t i = shardFor(lo); i < shards.size(); i++) {
+		if (i > 0 && !(bounds[i - 1] < hi)) {
+			break;
+		}
+		const Shard & s = *shards[i];
+		std::shared_lock<std::shared_mutex> sl(s.lock);
+		for (auto it = s.list.lower_bound(lo); it != s.list.end() && it->first < hi; ++it) {
+			f(it->first, it->second);
+		}
+	}
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+std::vector<Key> ShardedSkipList<Key, Value, Alloc, LevelGen>::allKeysInOrder() const
+{
+	std::shared_lock<LayoutLock> l(layout);
+	std::vector<Key> keys;
+	for (const auto & s : shards) {
+		std::shared_lock<std::shared_mutex> sl(s->lock);
+		for (const auto & kv : s->list) {
+			keys.push_back(kv.first);
+		}
+	}
+	return keys;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+bool ShardedSkipList<Key, Value, Alloc, LevelGen>::rebalance()
+{
+	// with the layout held exclusively no operation is inside any shard
+	std::unique_lock<LayoutLock> l(layout);
+	size_t n = shards.size();
+	size_t total = 0;
+	size_t hot = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t w = shards[i]->writes.load(std::memory_order_relaxed);
+		total += w;
+		if (w > shards[hot]->writes.load(std::memory_order_relaxed)) {
+			hot = i;
+		}
+	}
+	size_t hotWrites = shards[hot]->writes.load(std::memory_order_relaxed);
+	List & list = shards[hot]->list;
+	// hot means more than twice the average, i.e. hotWrites > 2 * total / n
+	bool moved = false;
+	if (n >= 2 && hotWrites * n > 2 * total && list.size() >= 2) {
+		bool intoNext;
+		if (hot == 0) {
+			intoNext = true;
+		} else if (hot + 1 == n) {
+			intoNext = false;
+		} else {
+			intoNext = shards[hot + 1]->writes.load(std::memory_order_relaxed) <
+			           shards[hot - 1]->writes.load(std::memory_order_relaxed);
+		}
+		// a key near the middle is the new boundary; it is never the first,
+		// so both halves keep something
+		Key median = list.middle()->first;
+
+		List upper(alloc);
+		list.split(median, upper);
+		if (intoNext) {
+			shards[hot + 1]->list.merge(std::move(upper));
+			bounds[hot] = median;
+		} else {
+			shards[hot - 1]->list.merge(std::move(list));
+			list.merge(std::move(upper));
+			bounds[hot - 1] = median;
+		}
+		moved = true;
+	}
+	for (auto & s : shards) {
+		s->writes.store(0, std::memory_order_relaxed);
+	}
+	return moved;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen>
+void ShardedSkipList<Key, Value, Alloc, LevelGen>::setAutoRebalance(size_t writes)
+{
+	{
+		std::lock_guard<std::mutex> l(rebalancer_lock);
+		if (writes != 0 && !rebalancer.joinable()) {
+			rebalancer = std::thread([this]() { rebalanceLoop(); });
+		}
+	}
+	auto_every.store(writes, std::memory_order_relaxed);
+	writes_since_check.store(0, std::memory_order_relaxed);
+}
+
+#endif
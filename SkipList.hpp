@@ -4,12 +4,135 @@
 #ifndef ___SKIP_LIST_HPP
 #define ___SKIP_LIST_HPP
 
-#include <cmath> // for log2
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "LevelGenerators.hpp"
+#include "SnapshotFormat.hpp"
 #include "runtimeexcept.hpp"
 #include <iostream>
 
+// Define SKIPLIST_DEBUG_NAMES before including this header to give the
+// sentinel nodes printable names ("head" / "tail") for debugging. It is off
+// by default because it adds a std::string to every node.
+
+// Define SKIPLIST_STATS to have every SkipList count the work its searches
+// and inserts do (see SkipListStats). It is off by default because it puts
+// a counter update in the search loops. Lookups update the counters too,
+// so with it on even const methods must not run concurrently.
+#ifdef SKIPLIST_STATS
+#define SKIPLIST_STAT(field, n) (op_stats.field += (n))
+#else
+#define SKIPLIST_STAT(field, n) ((void)0)
+#endif
+
+// Searches and scans prefetch the node they will need next while they
+// compare the current one: the tower one layer down from each node a
+// descent steps onto, and a node or two ahead (through layer 1) along S_0.
+// Define SKIPLIST_NO_PREFETCH to leave the prefetches out, e.g. to measure
+// them; compilers other than GCC and Clang never emit them.
+#if defined(SKIPLIST_NO_PREFETCH) || !(defined(__GNUC__) || defined(__clang__))
+#define SKIPLIST_PREFETCH(p) ((void)0)
+#else
+#define SKIPLIST_PREFETCH(p) __builtin_prefetch(p)
+#endif
+
+// What SkipList::stats() reports. All zero unless SKIPLIST_STATS is defined.
+struct SkipListStats
+{
+#ifdef SKIPLIST_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Descents from head: lookups, bounds, and the search half of insert
+    // and erase. Finger searches and batch inserts are not counted.
+    size_t searches = 0;
+    // Links followed along a layer / layers dropped, over all searches.
+    size_t horizontalSteps = 0;
+    size_t verticalSteps = 0;
+
+    // Towers linked by insert (not the bulk loader), how many layers above
+    // S_0 they got in total, and how often a height hit the layer cap.
+    size_t inserts = 0;
+    size_t promotions = 0;
+    size_t capHits = 0;
+
+    // Expected to stay near 2 * log2(n) for a healthy list.
+    double averageSearchSteps() const noexcept {
+        return searches == 0 ? 0.0 : double(horizontalSteps + verticalSteps) / double(searches);
+    }
+};
+
+// What SkipList::memoryUsage() reports. The counts are kept up to date by
+// every operation that allocates or frees a node, so reading them costs
+// nothing like a walk of the list.
+struct SkipListMemory
+{
+    // Everything below: the node memory the list has allocated, plus the
+    // heap memory its keys own (see SkipListHeapBytes).
+    size_t bytes = 0;
+
+    // Towers (one per key) and the two sentinels, and their bytes; a
+    // sentinel's tower is as tall as the list can ever get.
+    size_t nodes = 0;
+    size_t sentinels = 0;
+    size_t sentinelBytes = 0;
+
+    // What the towers spend on their keys (in the node, and on the heap),
+    // on their values (in the node only), and on links to the next tower
+    // on each layer (with a Ranked list's spans). The rest of the tower
+    // bytes, overheadBytes, is the node header, key prefix and padding.
+    size_t keyBytes = 0;
+    size_t valueBytes = 0;
+    size_t linkBytes = 0;
+    size_t overheadBytes = 0;
+
+    // Entry i is how many towers occupy layer S_i, as for layerHistogram().
+    std::vector<size_t> layerNodes;
+};
+
+// SkipListHeapBytes<T>::of(x): how much heap memory x owns, which a node
+// holding x pays for beyond sizeof(T). SkipList counts it for keys, which
+// cannot change while in the list; values can be changed in place through
+// references, so their payload is only sizeof(Value). It is 0 by default
+// and the allocated capacity for a std::string that is not stored inline;
+// specialize it for other key types.
+template<typename T, typename = void>
+struct SkipListHeapBytes
+{
+    static size_t of(const T &) noexcept { return 0; }
+};
+
+template<>
+struct SkipListHeapBytes<std::string>
+{
+    static size_t of(const std::string & s) noexcept
+    {
+        const char* inline_begin = reinterpret_cast<const char*>(&s);
+        bool inlined = s.data() >= inline_begin && s.data() < inline_begin + sizeof(s);
+        return inlined ? 0 : s.capacity() + 1;
+    }
+};
+
 /**
  * flipCoin -- NOTE: Only read if you are interested in how the
  * coin flipping works.
@@ -122,48 +245,393 @@ inline bool flipCoin(std::string key, unsigned previousFlips)
 	return ( c & (1 << previousFlips) ) != 0;	
 }
 
-template<typename Key, typename Value>
+/**
+ * @brief The default level generator: the original height rule, built
+ * on flipCoin.
+ *
+ * Keep flipping while flipCoin says heads and the list has fewer than
+ * `maxLayers` layers, counting a new layer whenever the tower would otherwise
+ * reach the empty top one. Note that once the list has `maxLayers` layers
+ * every new key gets height 1. See LevelGenerators.hpp for generators
+ * that do not depend on the key's bits.
+ */
+struct FlipCoinLevels
+{
+	template<typename Key>
+	unsigned operator()(const Key & k, unsigned layers, unsigned maxLayers) const
+	{
+		unsigned currLayer = 0;
+		while (flipCoin(k, currLayer) && layers < maxLayers) {
+			if (currLayer + 1 >= layers - 1) {
+				layers++;
+			}
+			++currLayer;
+		}
+		return currLayer + 1;
+	}
+};
+
+// The default cap on the layers of a list of n keys: 3 * ceil(log2(n + 1))
+// + 1, and 13 below 16 keys. Integer arithmetic only, as inserts ask for it
+// every time.
+inline unsigned layerCapFor(size_t n) noexcept
+{
+	if (n < 16) {
+		return 13;
+	}
+	// ceil(log2(n + 1)) is the bit width of n
+#if defined(__GNUC__) || defined(__clang__)
+	unsigned width = std::numeric_limits<unsigned long long>::digits - __builtin_clzll(n);
+#else
+	unsigned width = 0;
+	for (size_t m = n; m != 0; m >>= 1) {
+		width++;
+	}
+#endif
+	return 3 * width + 1;
+}
+
+// Allocators that free all of their memory at once when the last copy is
+// destroyed (see ArenaAllocator) advertise it with a `releases_in_bulk`
+// member type; SkipList then skips the per-node walk in its destructor
+// when the nodes have nothing to destroy.
+template<typename A, typename = void>
+struct releasesInBulk : std::false_type {};
+
+template<typename A>
+struct releasesInBulk<A, std::void_t<typename A::releases_in_bulk>> : A::releases_in_bulk {};
+
+// Key prefixes: when KeyPrefix<Key, Compare>::enabled, every tower also
+// caches `of(key)`, a uint64_t whose order agrees with Compare wherever
+// two prefixes differ. Searches compare those integers first and only read
+// the keys themselves on a tie, which for long strings saves following
+// the pointer to their characters on almost every step. It is on for
+// std::string under its natural order, where the prefix is the first 8
+// bytes read big-endian (zero-padded); specialize KeyPrefix to turn it on
+// for other keys, or off.
+template<typename Key, typename Compare, typename = void>
+struct KeyPrefix
+{
+	static constexpr bool enabled = false;
+};
+
+template<typename Compare>
+struct KeyPrefix<std::string, Compare,
+		std::enable_if_t<std::is_same<Compare, std::less<std::string>>::value || std::is_same<Compare, std::less<>>::value>>
+{
+	static constexpr bool enabled = true;
+
+	static uint64_t of(std::string_view s) noexcept
+	{
+		uint64_t p = 0;
+		for (size_t i = 0; i < 8; i++) {
+			p = p << 8 | (i < s.size() ? static_cast<unsigned char>(s[i]) : 0u);
+		}
+		return p;
+	}
+};
+
+// Where a Node keeps its prefix, when it has one.
+template<bool Prefixed>
+struct KeyPrefixSlot {};
+
+template<>
+struct KeyPrefixSlot<true>
+{
+	uint64_t prefix = 0;
+};
+
+template<typename Key, typename Value,
+         typename Alloc = std::allocator<std::pair<const Key, Value>>,
+         typename LevelGen = FlipCoinLevels,
+         bool Ranked = false,
+         typename Compare = std::less<Key>>
 class SkipList
 {
 
 
 private:
 	// private variables go here.
-	class Node{
+
+    // Every key lives in exactly one Node (its "tower"). The key and value
+    // are stored once, as the pair iterators point at, and `next` holds one
+    // forward link per layer the key occupies, so `next[0]` is the S_0 link
+    // and `next[height - 1]` is the highest one. Nodes are over-allocated
+    // by makeNode / makeTower so that `next` really has `height` entries.
+    // Only the bottom layer is doubly linked. A Ranked list also stores,
+    // right after next[height - 1], one span per link: how many S_0 steps
+    // that link covers (see spans()). With KeyPrefix enabled the node also
+    // starts with its key's prefix.
+    static constexpr bool PREFIXED = KeyPrefix<Key, Compare>::enabled;
+
+	class Node : public KeyPrefixSlot<PREFIXED> {
     public:
         bool sentinel;
         unsigned height;
-        
-        Key key;
-        Value val;
-        Node* next;
+
+        std::pair<const Key, Value> kv;
         Node* prev;
-        Node* up;
-        Node* down;
-        
+
+#ifdef SKIPLIST_DEBUG_NAMES
+        // only the sentinels are named; code must use the sentinel flag or
+        // compare against head/tail instead of reading this
         std::string name;
+#endif
+
+        Node* next[1]; // must stay last, see makeNode
+
+        explicit Node(unsigned h): sentinel(true), height(h), kv(sentinelKey(), Value()), prev(nullptr){}
+
+        // the arguments construct kv in place, as for std::pair
+        template<typename A, typename... Args>
+        Node(unsigned h, A&& a, Args&&... args):
+                sentinel(false), height(h), kv(std::forward<A>(a), std::forward<Args>(args)...), prev(nullptr){
+            if constexpr (PREFIXED) {
+                this->prefix = KeyPrefix<Key, Compare>::of(kv.first);
+            }
+        }
+
+    };
+
+    // Integral keys ordered by std::less give the sentinels the largest
+    // possible key, which acts as +inf for tail: no key is greater, so the
+    // inner search loops can test `nxt->kv.first < k` without first
+    // checking for tail. Other key types and orders keep the explicit test.
+    static constexpr bool TAIL_IS_MAX = std::is_integral<Key>::value &&
+            (std::is_same<Compare, std::less<Key>>::value || std::is_same<Compare, std::less<>>::value);
+
+    static Key sentinelKey() {
+        if constexpr (TAIL_IS_MAX) {
+            return std::numeric_limits<Key>::max();
+        } else {
+            return Key();
+        }
+    }
+
+    // The key order, and equivalence under it: neither key is less.
+    template<typename A, typename B>
+    bool keyLess(const A & a, const B & b) const { return key_less(a, b); }
+    template<typename A, typename B>
+    bool sameKey(const A & a, const B & b) const { return !key_less(a, b) && !key_less(b, a); }
+
+    // Does n come strictly before k? n may be tail, never head. A lookup
+    // key of another type could be past the sentinel's, so it always
+    // tests for tail.
+    template<typename K>
+    bool before(const Node* n, const K & k) const {
+        if constexpr (TAIL_IS_MAX && std::is_same<K, Key>::value) {
+            return keyLess(n->kv.first, k);
+        } else {
+            return n != tail && keyLess(n->kv.first, k);
+        }
+    }
 
-        Node(): sentinel(true), next(nullptr), prev(nullptr), up(nullptr), down(nullptr){}
+    // Does k come strictly before n? n may be tail, which counts as after.
+    template<typename K>
+    bool after(const Node* n, const K & k) const {
+        return n == tail || keyLess(k, n->kv.first);
+    }
 
-        Node(const Key& k, const Value& v):
-                sentinel(false), height(0), key(k), val(v), 
-                next(nullptr), prev(nullptr), up(nullptr), down(nullptr){}
+    // Is n, which a descent for k stopped at (so not before k), k itself?
+    template<typename K>
+    bool matches(const Node* n, const K & k) const {
+        return !after(n, k);
+    }
 
-        
+    // A lookup key with its prefix worked out once, for a whole descent;
+    // before, after and matches take one in place of the key. probeFor
+    // makes one when KeyPrefix is enabled and k can be read as a string,
+    // and otherwise hands k straight back.
+    template<typename K>
+    struct Probe {
+        const K & key;
+        uint64_t prefix;
     };
 
-    Node* top_l = new Node();
-    Node* top_tail = new Node();
-    Node* bottom_l = new Node();
-    Node* bottom_tail = new Node();
+    template<typename K>
+    static decltype(auto) probeFor(const K & k) {
+        if constexpr (PREFIXED && std::is_convertible<const K &, std::string_view>::value) {
+            return Probe<K>{k, KeyPrefix<Key, Compare>::of(std::string_view(k))};
+        } else {
+            return k;
+        }
+    }
+
+    template<typename K>
+    bool before(const Node* n, const Probe<K> & p) const {
+        if (n == tail) {
+            return false;
+        }
+        return n->prefix != p.prefix ? n->prefix < p.prefix : keyLess(n->kv.first, p.key);
+    }
+
+    template<typename K>
+    bool after(const Node* n, const Probe<K> & p) const {
+        if (n == tail) {
+            return true;
+        }
+        return n->prefix != p.prefix ? p.prefix < n->prefix : keyLess(p.key, n->kv.first);
+    }
+
+    // A descent that stepped onto n on `layer` goes on either along the
+    // layer or down n's tower; fetch the node down there while the one
+    // along is compared.
+    static void prefetchBelow(const Node* n, unsigned layer) noexcept {
+        if (layer > 0) {
+            SKIPLIST_PREFETCH(n->next[layer - 1]);
+        }
+    }
+
+    // A scan along S_0 at n: a tower that reaches layer 1 knows the node a
+    // couple of steps ahead, so start fetching it before the walk gets there.
+    static void prefetchAhead(const Node* n) noexcept {
+        if (n->height > 1) {
+            SKIPLIST_PREFETCH(n->next[1]);
+        }
+    }
+
+    // Upper bound on numLayers(): the adaptive cap is 3 * ceil(log2(n + 1)) + 1
+    // (see maxLayersFor), n can never exceed the range of size_t, and
+    // setMaxLayers allows no more.
+    static constexpr unsigned MAX_LAYERS = 3 * std::numeric_limits<size_t>::digits + 1;
+
+    // Nodes are allocated as runs of Slots so that Alloc only ever sees one
+    // fixed type with the alignment a Node needs.
+    struct alignas(Node) Slot { unsigned char bytes[alignof(Node)]; };
+    using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+    using SlotTraits = std::allocator_traits<SlotAlloc>;
+
+    // span[i] of node n is the number of keys from n (exclusive) to
+    // n->next[i] (inclusive), counting tail as one. Only Ranked lists
+    // allocate room for them.
+    static size_t* spans(Node* n) noexcept {
+        return reinterpret_cast<size_t*>(n->next + n->height);
+    }
+
+    static size_t slotsFor(unsigned h) noexcept;
+    Node* makeNode(unsigned h);
+    template<typename... Args>
+    Node* makeTower(unsigned h, Args&&... args);
+    void destroyNode(Node* n) noexcept;
+
+    SlotAlloc node_alloc;
+    LevelGen level_gen;
+    Compare key_less;
+
+    // head is a tower of MAX_LAYERS links, so adding a layer never has to
+    // allocate; links at or above sl_layers always point to tail.
+    Node* head;
+    Node* tail;
     size_t sl_size; // num of keys
     unsigned sl_layers;
+    unsigned fixed_max_layers; // 0 when the cap adapts, see setMaxLayers
+
+    // Memory accounting (see memoryUsage()): the bytes of all nodes
+    // allocated, the heap bytes the keys own, and how many towers there
+    // are of each height. makeNode, makeTower and destroyNode keep `tally`
+    // up to date; code that moves nodes between lists moves their share.
+    struct NodeTally {
+        size_t nodeBytes = 0;
+        size_t keyHeapBytes = 0;
+        size_t heights[MAX_LAYERS + 1] = {};
+
+        void add(const Node* n) noexcept {
+            nodeBytes += slotsFor(n->height) * sizeof(Slot);
+            if (!n->sentinel) {
+                keyHeapBytes += SkipListHeapBytes<Key>::of(n->kv.first);
+                heights[n->height]++;
+            }
+        }
+
+        void remove(const Node* n) noexcept {
+            nodeBytes -= slotsFor(n->height) * sizeof(Slot);
+            if (!n->sentinel) {
+                keyHeapBytes -= SkipListHeapBytes<Key>::of(n->kv.first);
+                heights[n->height]--;
+            }
+        }
+
+        void absorb(const NodeTally & other) noexcept {
+            nodeBytes += other.nodeBytes;
+            keyHeapBytes += other.keyHeapBytes;
+            for (unsigned h = 0; h <= MAX_LAYERS; h++) {
+                heights[h] += other.heights[h];
+            }
+        }
+    };
+    NodeTally tally;
+
+    // makeTower, counting the tower in t rather than in this list's tally,
+    // for threads building towers side by side
+    template<typename... Args>
+    Node* makeTowerIn(NodeTally & t, unsigned h, Args&&... args);
+
+#ifdef SKIPLIST_STATS
+    mutable SkipListStats op_stats;
+#endif
 
 
 public:
 
+	// Bidirectional iterators over S_0 in increasing key order. Erasing an
+	// element only invalidates iterators to that element.
+	template<bool IsConst>
+	class Iterator
+	{
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = std::pair<const Key, Value>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = typename std::conditional<IsConst, const value_type*, value_type*>::type;
+		using reference = typename std::conditional<IsConst, const value_type&, value_type&>::type;
+
+		Iterator() noexcept : node(nullptr) {}
+
+		// iterator converts to const_iterator, not the other way around
+		template<bool WasConst, typename = typename std::enable_if<IsConst && !WasConst>::type>
+		Iterator(const Iterator<WasConst> & other) noexcept : node(other.node) {}
+
+		reference operator*() const noexcept { return node->kv; }
+		pointer operator->() const noexcept { return &node->kv; }
+
+		Iterator & operator++() noexcept { node = node->next[0]; return *this; }
+		Iterator operator++(int) noexcept { Iterator old = *this; node = node->next[0]; return old; }
+		Iterator & operator--() noexcept { node = node->prev; return *this; }
+		Iterator operator--(int) noexcept { Iterator old = *this; node = node->prev; return old; }
+
+		template<bool OtherConst>
+		bool operator==(const Iterator<OtherConst> & other) const noexcept { return node == other.node; }
+		template<bool OtherConst>
+		bool operator!=(const Iterator<OtherConst> & other) const noexcept { return node != other.node; }
+
+	private:
+		friend class SkipList;
+		template<bool> friend class Iterator;
+		explicit Iterator(Node* n) noexcept : node(n) {}
+
+		Node* node;
+	};
+
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
 	SkipList();
 
+	// Draw every node, sentinels included, from this allocator.
+	explicit SkipList(const Alloc & alloc);
+
+	// Use this level generator (for example a seeded XorShiftLevels).
+	explicit SkipList(const LevelGen & levels, const Alloc & alloc = Alloc());
+
+	// Order the keys by comp instead of Compare().
+	explicit SkipList(const Compare & comp, const LevelGen & levels = LevelGen(), const Alloc & alloc = Alloc());
+
+	// Build from key/value pairs already sorted by key; see assignSorted.
+	template<typename InputIt>
+	SkipList(InputIt first, InputIt last, const Alloc & alloc = Alloc());
+
 	// You DO NOT need to implement a copy constructor or an assignment operator.
 
 	~SkipList();
@@ -184,6 +652,22 @@ public:
 	// This "empty" Skip List has two layers and a height of one.
 	unsigned numLayers() const noexcept;
 
+	// The cap insert puts on numLayers(). By default it adapts to the size
+	// of the list: maxLayersFor(size()), which is layerCapFor(size()),
+	// 3 * ceil(log2(n + 1)) + 1 and 13 below 16 keys. setMaxLayers(layers)
+	// fixes it instead, e.g. at maxLayersFor(capacity) for a list that will
+	// hold about `capacity` keys, so that early towers are as tall as the
+	// full list needs; 0 goes back to adapting. Throw a RuntimeException if
+	// layers is 1 or above the most any list can have. Only insert is
+	// capped, and a lower cap leaves taller towers already in the list as
+	// they are.
+	void setMaxLayers(unsigned layers);
+	unsigned maxLayers() const noexcept;
+	static unsigned maxLayersFor(size_t n) noexcept;
+
+	// A copy of the allocator the nodes come from.
+	Alloc get_allocator() const noexcept;
+
 	// What is the height of this key, assuming the "base" layer S_0
 	// contains keys with a height of 1?
 	// For example, "0" has a height of 1 in the following skip list.
@@ -213,7 +697,44 @@ public:
 	// These return the value associated with the given key.
 	// Throw a RuntimeException if the key does not exist.
 	Value & find(const Key & k);
-	const Value & find(Key k) const;
+	const Value & find(const Key & k) const;
+
+	// Non-throwing lookups: a miss costs one descent and nothing more.
+	// tryFind returns a pointer to the value, or nullptr if k is missing.
+	bool contains(const Key & k) const;
+	Value * tryFind(const Key & k);
+	const Value * tryFind(const Key & k) const;
+
+	// With a transparent Compare (one with an is_transparent member, such
+	// as std::less<>), the lookups also take anything Compare can order
+	// against Key -- a std::string_view or const char* for std::string
+	// keys, say -- and never build a Key from it. See also lower_bound.
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	Value & find(const K & k);
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	const Value & find(const K & k) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	bool contains(const K & k) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	Value * tryFind(const K & k);
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	const Value * tryFind(const K & k) const;
+
+	// The order the keys are kept in.
+	Compare key_comp() const { return key_less; }
+
+	// tryFind for every key in keys, in that order. The descents run
+	// interleaved, a few at a time, each step prefetching the nodes its
+	// descent needs next and moving on to the others while they arrive, so
+	// on a list that does not fit in cache the memory waits overlap
+	// instead of adding up.
+	std::vector<Value*> findMany(const std::vector<Key> & keys);
+	std::vector<const Value*> findMany(const std::vector<Key> & keys) const;
+
+	// nextKey / previousKey without exceptions: empty if k does not
+	// exist or has no neighbour on that side.
+	std::optional<Key> tryNextKey(const Key & k) const;
+	std::optional<Key> tryPreviousKey(const Key & k) const;
 
 	// Return true if this key/value pair is successfully inserted, false otherwise.
 	// See the project write-up for conditions under which the key should be "bubbled up"
@@ -221,168 +742,665 @@ public:
 	// If the key already exists, do not insert one -- return false.
 	bool insert(const Key & k, const Value & v);
 
+	// Same as above, but moves the key and value into the list.
+	bool insert(Key && k, Value && v);
+
+	// Build a key/value pair from args (as std::pair would) and insert it.
+	// Return an iterator to the element with that key and whether it was
+	// inserted. The pair is built before the search, so if the key is at
+	// hand try_emplace avoids constructing a value for nothing.
+	template<typename... Args>
+	std::pair<iterator, bool> emplace(Args&&... args);
+
+	// If k is not present, insert it with a value constructed in place
+	// from args; otherwise leave everything (args included) untouched.
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace(const Key & k, Args&&... args);
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace(Key && k, Args&&... args);
+
+	// Insert k, or assign v to its value if it is already present, with a
+	// single descent. The bool is true if k was inserted.
+	template<typename V>
+	std::pair<iterator, bool> insert_or_assign(const Key & k, V && v);
+	template<typename V>
+	std::pair<iterator, bool> insert_or_assign(Key && k, V && v);
+
+	// Return the value for k, inserting factory() first if k is missing.
+	// One descent either way; factory is only called on a miss.
+	template<typename Factory>
+	Value & findOrInsert(const Key & k, Factory && factory);
+
+	// Return the value for k, inserting a default-constructed one first
+	// if k is missing.
+	Value & operator[](const Key & k);
+	Value & operator[](Key && k);
+
+	// Insert every key/value pair in [first, last), as if by calling insert
+	// on each in turn (earlier pairs win over later ones with the same key),
+	// and return how many were inserted. The batch is copied and sorted so
+	// that consecutive keys can reuse one predecessor array.
+	template<typename InputIt>
+	size_t insertBatch(InputIt first, InputIt last);
+
+	// insertBatch for input that is already sorted by key: no copy, no sort.
+	// Each key's descent resumes from the previous key's predecessors, so
+	// only new ground is covered. A key smaller than the one before it
+	// just costs a normal descent.
+	template<typename InputIt>
+	size_t insertSortedBatch(InputIt first, InputIt last);
+
+	// Replace the contents with the pairs in [first, last), which must be
+	// sorted by key. The layers are linked in one pass without any search:
+	// the i-th key (counting from 1) gets height 1 + the number of trailing
+	// zero bits of i, which gives a perfectly balanced list. Repeated keys
+	// keep their first value, like insert.
+	// Throw a RuntimeException (leaving the list empty) if a key is smaller
+	// than the one before it.
+	template<typename InputIt>
+	void assignSorted(InputIt first, InputIt last);
+
+	// Replace the contents with the pairs in [first, last), in any order;
+	// where keys repeat the earliest pair wins, as with insertBatch. The
+	// pairs are sorted and the towers built and linked by `threads`
+	// threads (0 means one per hardware thread), each on its own range of
+	// keys, and the ranges are then stitched together on every layer. The
+	// result is the same perfectly balanced list assignSorted builds. The
+	// allocator must be safe to use from several threads at once.
+	template<typename InputIt>
+	void assignParallel(InputIt first, InputIt last, unsigned threads = 0);
+
+	// Call fn on every element, from `threads` threads at once (0 means one
+	// per hardware thread), each walking its own run of S_0. The runs are
+	// cut at nodes of an upper layer with enough towers to give every
+	// thread a similar share. fn must be safe to call concurrently on
+	// different elements; the first exception it throws is rethrown once
+	// every thread has stopped.
+	template<typename F>
+	void parallelForEach(F && fn, unsigned threads = 0);
+	template<typename F>
+	void parallelForEach(F && fn, unsigned threads = 0) const;
+
+	// allKeysInOrder, with the walk split up like parallelForEach. Key
+	// must be default-constructible.
+	std::vector<Key> parallelAllKeysInOrder(unsigned threads = 0) const;
+
+	// Remove every key.
+	void clear() noexcept;
+
+	// Move every element of other into this list without copying: the
+	// two bottom layers are merged in one pass and the towers relinked in
+	// place. Where both lists hold a key, this list's element wins and
+	// other's is destroyed. other is left empty. If the allocators compare
+	// unequal the elements are moved into new nodes instead. O(n + m).
+	void merge(SkipList && other);
+
+	// Replace the contents with the union / intersection / difference
+	// (keys of a not in b) of a and b, walking both in order at once. The
+	// result is built like assignSorted, so it is perfectly balanced. On
+	// keys in both, a's value is kept. O(|a| + |b|). Throw a
+	// RuntimeException if this list is a or b.
+	void assignUnion(const SkipList & a, const SkipList & b);
+	void assignIntersection(const SkipList & a, const SkipList & b);
+	void assignDifference(const SkipList & a, const SkipList & b);
+
+	// Move every key not less than k into upper, replacing its contents.
+	// Each layer is cut after k's predecessor, so only the moved keys'
+	// count has to be walked (nothing at all on a Ranked list). Throw a
+	// RuntimeException if upper is this list or has an unequal allocator.
+	void split(const Key & k, SkipList & upper);
+
+	// Write the list to out as a binary snapshot (see SnapshotFormat.hpp):
+	// every key and value in order plus the height of its tower, so load
+	// rebuilds exactly this structure. Keys and values must be trivially
+	// copyable or std::string. Throw a RuntimeException if writing fails.
+	void save(std::ostream & out) const;
+
+	// Replace the contents with a snapshot written by save, linking the
+	// towers in one pass without any search. Throw a RuntimeException
+	// (leaving the list empty) if the snapshot is malformed or was saved
+	// from a list with other key or value types.
+	void load(std::istream & in);
+
 	// Return a vector containing all inserted keys in increasing order.
 	std::vector<Key> allKeysInOrder() const;
 
+	// Entry i is how many keys occupy layer S_i, for every layer
+	// (the empty top one included). Walks S_0, so it is O(n).
+	std::vector<size_t> layerHistogram() const;
+
+	// Counters for the work done since construction or resetStats().
+	// See SKIPLIST_STATS above.
+	SkipListStats stats() const noexcept;
+	void resetStats() noexcept;
+
+	// Memory accounting, O(1): the bytes of every node allocated (sentinels
+	// included) plus the heap memory the keys own, and how many nodes that
+	// is. Every key is one tower, so nodeCount() is size() + 2.
+	// memoryUsage() breaks the bytes down; it is O(numLayers()).
+	size_t bytesUsed() const noexcept;
+	size_t nodeCount() const noexcept;
+	SkipListMemory memoryUsage() const;
+
+	// Order statistics, O(log n) each. Only available when the list is
+	// declared Ranked (SkipList<Key, Value, Alloc, LevelGen, true>), which
+	// keeps a span next to every link.
+	//
+	// rankOf: how many keys are less than k (k need not exist).
+	// keyAtRank: the key with exactly i smaller keys. Throw a
+	// RuntimeException if i >= size().
+	// countInRange: how many keys lie in [a, b).
+	size_t rankOf(const Key & k) const;
+	Key keyAtRank(size_t i) const;
+	size_t countInRange(const Key & a, const Key & b) const;
+
 	// Is this the smallest key in the SkipList? Throw a RuntimeException
 	// if the key *k* does not exist in the Skip List. 
+	// O(1) when the answer is true, one search otherwise.
 	bool isSmallestKey(const Key & k) const;
 
 	// Is this the largest key in the SkipList? Throw a RuntimeException
 	// if the key *k* does not exist in the Skip List. 
+	// O(1) when the answer is true, one search otherwise.
 	bool isLargestKey(const Key & k) const;
 
-	// I am not requiring you to implement remove.
-	const bool search(const Key & k, Node *& n = nullptr) const;
+	// The smallest / largest key, and the element holding it, in O(1).
+	// Throw a RuntimeException if the list is empty.
+	Key minKey() const;
+	Key maxKey() const;
+	std::pair<const Key, Value> & front();
+	const std::pair<const Key, Value> & front() const;
+	std::pair<const Key, Value> & back();
+	const std::pair<const Key, Value> & back() const;
+
+	// Remove the smallest / largest element and hand it back, for use as
+	// a priority queue. popFront is O(1) (every predecessor is head).
+	// popBack is O(log n) expected: it walks back along S_0 to the last
+	// node's predecessor on each of its layers, as erase(iterator) does,
+	// without comparing keys; on a Ranked list it costs a descent.
+	// Throw a RuntimeException if the list is empty.
+	std::pair<Key, Value> popFront();
+	std::pair<Key, Value> popBack();
+
+	// The first key in order, and one past the last.
+	iterator begin() noexcept;
+	iterator end() noexcept;
+	const_iterator begin() const noexcept;
+	const_iterator end() const noexcept;
+	const_iterator cbegin() const noexcept;
+	const_iterator cend() const noexcept;
+	reverse_iterator rbegin() noexcept;
+	reverse_iterator rend() noexcept;
+	const_reverse_iterator rbegin() const noexcept;
+	const_reverse_iterator rend() const noexcept;
+
+	// An element near the middle, for splitting the list in about half
+	// without walking it: the middle tower of an upper layer with a few
+	// dozen towers, so O(log n) expected (a Ranked list finds the exact
+	// median by rank). Never the first element of a list of two or more;
+	// end() if the list is empty.
+	const_iterator middle() const;
+
+	// The first element whose key is not less than k / greater than k,
+	// or end(). Each costs one descent; walking the range after that is
+	// a plain S_0 scan.
+	iterator lower_bound(const Key & k);
+	const_iterator lower_bound(const Key & k) const;
+	iterator upper_bound(const Key & k);
+	const_iterator upper_bound(const Key & k) const;
+
+	// The same, for any key type a transparent Compare accepts.
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	iterator lower_bound(const K & k);
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	const_iterator lower_bound(const K & k) const;
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	iterator upper_bound(const K & k);
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	const_iterator upper_bound(const K & k) const;
+
+	// [lower_bound(k), upper_bound(k)) from a single descent.
+	std::pair<iterator, iterator> equal_range(const Key & k);
+	std::pair<const_iterator, const_iterator> equal_range(const Key & k) const;
+
+	// Finger search: like lower_bound, but starts from hint (any iterator
+	// returned earlier) instead of the top of head. When k is after hint
+	// this costs O(log d) in the distance d between them; otherwise it
+	// falls back to a normal descent.
+	iterator lower_bound(const_iterator hint, const Key & k);
+	const_iterator lower_bound(const_iterator hint, const Key & k) const;
+
+	// Finger search for exactly k; return end() if it does not exist.
+	iterator findNear(const_iterator hint, const Key & k);
+	const_iterator findNear(const_iterator hint, const Key & k) const;
+
+	// insert, starting the search from hint. Return an iterator to the
+	// new element, or to the existing one if the key was already present.
+	iterator insert(const_iterator hint, const Key & k, const Value & v);
+
+	// Remove this key and its whole tower. Empty layers left at the top
+	// are dropped, so numLayers() can shrink.
+	// Return true if the key was removed, false if it did not exist.
+	bool erase(const Key & k);
+
+	// Remove the element at pos without searching for it again and
+	// return an iterator to the element after it.
+	iterator erase(iterator pos);
+
+	// Remove this key and hand back its value.
+	// Throw a RuntimeException if the key does not exist.
+	Value extract(const Key & k);
+
+	const bool search(const Key & k, Node *& n) const;
 
-    const void bottomMost(Node *& n) const;
+private:
+    // Descends from the top layer and stores, for every layer, the last node
+    // whose key is less than k in update[layer]. Returns that S_0 node.
+    // A Ranked list also stores each predecessor's rank (head is 0) in
+    // rank[layer] when rank is given.
+    Node* findPredecessors(const Key & k, Node ** update, size_t * rank = nullptr) const;
+
+    // First S_0 node whose key is not less than k (lower) or greater than
+    // k (upper); tail if there is none.
+    template<typename K>
+    Node* lowerBoundNode(const K & k) const;
+    template<typename K>
+    Node* upperBoundNode(const K & k) const;
+
+    // The body of search, for any key type Compare accepts.
+    template<typename K>
+    bool searchFor(const K & k, Node *& n) const;
+
+    // Height for a new tower holding k, and the layer count the list needs
+    // for it. Nothing changes until linkTower commits both.
+    unsigned towerHeight(const Key & k, unsigned & layers);
+
+    // Links newNode after update[i] on every layer it occupies, growing the
+    // list to `layers` layers first. A Ranked list needs update[i] and its
+    // rank for every layer below `layers`; others ignore rank.
+    void linkTower(Node* newNode, Node ** update, unsigned layers, size_t * rank);
+
+    // Shared bodies of try_emplace and insert_or_assign.
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> tryEmplaceImpl(K && k, Args&&... args);
+    template<typename K, typename V>
+    std::pair<iterator, bool> assignImpl(K && k, V && v);
+
+    // Like findPredecessors, but starting from `from` when that is before k.
+    // Only update[0, filled) is set; completePredecessors fills the rest.
+    Node* fingerPredecessors(Node* from, const Key & k, Node ** update, unsigned & filled) const;
+    void completePredecessors(Node ** update, unsigned filled, unsigned levels) const;
+
+    // Fills update[0, x->height) with x's predecessors by walking back along
+    // S_0: the predecessor on a layer is the closest earlier node that
+    // reaches it.
+    void predecessorsOf(Node* x, Node ** update) const;
+
+    // Links towers at the end of an empty list, in key order, without any
+    // search: beginAppend, then append each tower, then endAppend to fix
+    // the layer count (and the spans to tail). Shared by assignSorted and
+    // load, which decide the heights themselves.
+    struct Appender {
+        Node* lastOn[MAX_LAYERS]; // the newest node on each layer
+        size_t lastRank[Ranked ? MAX_LAYERS : 1];
+        unsigned tallest;
+    };
+    void beginAppend(Appender & a) const noexcept;
+    void append(Appender & a, Node* newNode) noexcept;
+    void endAppend(Appender & a) noexcept;
+
+    // Splices x out of every layer using its predecessors and drops any
+    // layers that became empty. Does not free x. A Ranked list needs
+    // update[i] for every layer, not just the ones x occupies.
+    void unlink(Node* x, Node ** update);
+    void dropEmptyLayers() noexcept;
+
+    // Points head at tail on every layer and forgets the nodes, without
+    // freeing them.
+    void resetLinks() noexcept;
+
+    // Height of the i-th key (counting from 1) of a perfectly balanced
+    // list: 1 + the number of trailing zero bits of i.
+    static unsigned balancedHeight(size_t i) noexcept;
+
+    // append a copy of kv with its balanced height
+    void appendCopy(Appender & a, const std::pair<const Key, Value> & kv);
+
+    // How many threads to use for n keys when `threads` were asked for
+    // (0 = hardware): at least one, and no fewer than MIN_KEYS_PER_THREAD
+    // keys each.
+    static constexpr size_t MIN_KEYS_PER_THREAD = 4096;
+    static unsigned workersFor(size_t n, unsigned threads) noexcept;
+
+    // The found node for each of keys, or nullptr; see findMany.
+    static constexpr unsigned FIND_MANY_GROUP = 8;
+    std::vector<Node*> findManyNodes(const std::vector<Key> & keys) const;
+
+    // Run fn(0) .. fn(parts - 1) on parts threads (one of them this one)
+    // and wait for all of them. Then rethrow the exception of the lowest
+    // part that threw, if any. If a thread cannot be started, the parts
+    // from it on do not run and that failure counts as theirs.
+    template<typename F>
+    static void runParallel(unsigned parts, F && fn);
+
+    // parts + 1 S_0 positions splitting the list into parts runs of
+    // similar length; the last is tail.
+    std::vector<Node*> chunkStarts(unsigned parts) const;
+
+    template<typename F>
+    void forEachChunk(F && fn, unsigned threads) const;
 
 };
 
-template<typename Key, typename Value>
-const void SkipList<Key, Value>::bottomMost(SkipList::Node *&n) const {
-    // should update the passed in node and make it the bottomMost node in the layer.
-    // returning would be the bottom most node with that key/node
-    Node* temp = n;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::slotsFor(unsigned h) noexcept {
+    size_t bytes = sizeof(Node) + (h - 1) * sizeof(Node*) + (Ranked ? h * sizeof(size_t) : 0);
+    return (bytes + sizeof(Slot) - 1) / sizeof(Slot);
+}
 
-    while (temp->down != nullptr){
-        temp = temp->down;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::makeNode(unsigned h) {
+    Slot* mem = SlotTraits::allocate(node_alloc, slotsFor(h));
+    Node* n;
+    try {
+        n = new (mem) Node(h);
+    } catch (...) {
+        SlotTraits::deallocate(node_alloc, mem, slotsFor(h));
+        throw;
     }
-    n = temp;
+    for (unsigned i = 0; i < h; i++) {
+        n->next[i] = nullptr;
+        if constexpr (Ranked) {
+            spans(n)[i] = 0;
+        }
+    }
+    tally.add(n);
+    return n;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename... Args>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::makeTower(unsigned h, Args&&... args) {
+    return makeTowerIn(tally, h, std::forward<Args>(args)...);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename... Args>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::makeTowerIn(NodeTally & t, unsigned h, Args&&... args) {
+    Slot* mem = SlotTraits::allocate(node_alloc, slotsFor(h));
+    Node* n;
+    try {
+        n = new (mem) Node(h, std::forward<Args>(args)...);
+    } catch (...) {
+        SlotTraits::deallocate(node_alloc, mem, slotsFor(h));
+        throw;
+    }
+    for (unsigned i = 0; i < h; i++) {
+        n->next[i] = nullptr;
+        if constexpr (Ranked) {
+            spans(n)[i] = 0;
+        }
+    }
+    t.add(n);
+    return n;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::destroyNode(Node* n) noexcept {
+    size_t slots = slotsFor(n->height);
+    tally.remove(n);
+    n->~Node();
+    SlotTraits::deallocate(node_alloc, reinterpret_cast<Slot*>(n), slots);
 }
 
 
-template<typename Key, typename Value>
-const bool SkipList<Key, Value>::search(const Key& k, Node *& n) const {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+const bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::search(const Key& k, Node *& n) const {
+    return searchFor(k, n);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::searchFor(const K& k, Node *& n) const {
     // if return is false, then n = the node before where the insert would of taken place
     // if return is true, then n = the position in which the node was found.
 
-    Node *temp = top_l;
-    Node *no_null = temp;
+    const auto & key = probeFor(k);
+    Node* temp = head;
+    SKIPLIST_STAT(searches, 1);
+    // the top layer is always empty, so start one below it
+    for (unsigned layer = sl_layers - 1; layer-- > 0;) {
+        SKIPLIST_STAT(verticalSteps, 1);
+        Node* nxt = temp->next[layer];
+        while (before(nxt, key)) {
+            SKIPLIST_STAT(horizontalSteps, 1);
+            temp = nxt;
+            nxt = temp->next[layer];
+            prefetchBelow(temp, layer);
+        }
+        if (matches(nxt, key)) {
+            n = nxt;
+            return true;
+        }
+    }
+    // if no key was found, then return a position thats less than the key
+    n = temp;
+    return false;
+}
 
-    while (temp != bottom_tail && temp != nullptr) {
-        if (temp->sentinel == true) {
-            if (temp->next->sentinel == true) {
-                temp = temp->down;
-            } else {
-                temp = temp->next;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findPredecessors(const Key& k, Node ** update, size_t * rank) const {
+    const auto & key = probeFor(k);
+    Node* temp = head;
+    size_t r = 0;
+    SKIPLIST_STAT(searches, 1);
+    for (unsigned layer = sl_layers; layer-- > 0;) {
+        SKIPLIST_STAT(verticalSteps, 1);
+        Node* nxt = temp->next[layer];
+        while (before(nxt, key)) {
+            SKIPLIST_STAT(horizontalSteps, 1);
+            if constexpr (Ranked) {
+                r += spans(temp)[layer];
             }
+            temp = nxt;
+            nxt = temp->next[layer];
+            prefetchBelow(temp, layer);
+        }
+        update[layer] = temp;
+        if (Ranked && rank != nullptr) {
+            rank[layer] = r;
+        }
+    }
+    return temp;
+}
 
-        } else {
-            if (temp->key == k) {
-                n = temp;
-                bottomMost(n);
-                return true;
-            }
-            if (temp->key > k) {
-                no_null = temp;
-                temp = temp->prev->down;
-            } else {
-                no_null = temp;
-                if (temp->next->sentinel == true) {
-                    if (temp == bottom_tail) {
-                        temp = temp->next;
-                    } else { temp = temp->down; }
-                } else {
-                    temp = temp->next;
-                }
-            }
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lowerBoundNode(const K& k) const {
+    const auto & key = probeFor(k);
+    Node* temp = head;
+    SKIPLIST_STAT(searches, 1);
+    for (unsigned layer = sl_layers - 1; layer-- > 0;) {
+        SKIPLIST_STAT(verticalSteps, 1);
+        Node* nxt = temp->next[layer];
+        while (before(nxt, key)) {
+            SKIPLIST_STAT(horizontalSteps, 1);
+            temp = nxt;
+            nxt = temp->next[layer];
+            prefetchBelow(temp, layer);
         }
     }
-    // if no key was found, then return a position thats less than the key
-    if (no_null->sentinel == true) {
-        n = no_null;
-    } else {
-        if (no_null->key < k) {
-            n = no_null;
-        } else { n = no_null->prev; }
-        return false;
+    return temp->next[0];
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::upperBoundNode(const K& k) const {
+    const auto & key = probeFor(k);
+    Node* temp = head;
+    SKIPLIST_STAT(searches, 1);
+    for (unsigned layer = sl_layers - 1; layer-- > 0;) {
+        SKIPLIST_STAT(verticalSteps, 1);
+        Node* nxt = temp->next[layer];
+        while (!after(nxt, key)) {
+            SKIPLIST_STAT(horizontalSteps, 1);
+            temp = nxt;
+            nxt = temp->next[layer];
+            prefetchBelow(temp, layer);
+        }
     }
-    return false;
+    return temp->next[0];
 }
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::predecessorsOf(Node* x, Node ** update) const {
+    Node* y = x->prev;
+    unsigned layer = 0;
+    while (layer < x->height) {
+        while (y->height <= layer) {
+            y = y->prev;
+        }
+        // head reaches every layer, so this always terminates
+        unsigned top = y->height < x->height ? y->height : x->height;
+        while (layer < top) {
+            update[layer++] = y;
+        }
+    }
+}
 
-template<typename Key, typename Value>
-SkipList<Key, Value>::SkipList() {
-    // look into if bottom_l should be used or how to avoid using it accidentally when looping
-    top_l->down = bottom_l;
-    top_l->next = top_tail;
-    top_l->name = "top_l";
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::unlink(Node* x, Node ** update) {
+    for (unsigned i = 0; i < x->height; i++) {
+        update[i]->next[i] = x->next[i];
+        if constexpr (Ranked) {
+            spans(update[i])[i] += spans(x)[i] - 1;
+        }
+    }
+    if constexpr (Ranked) {
+        // links that jumped over x now cover one key less
+        for (unsigned i = x->height; i < sl_layers; i++) {
+            spans(update[i])[i]--;
+        }
+    }
+    x->next[0]->prev = x->prev;
+    sl_size--;
+    dropEmptyLayers();
+}
 
-    top_tail->prev = top_l;
-    top_tail->down = bottom_tail;
-    top_tail->next = nullptr;
-    top_tail->name = "top_tail";
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::dropEmptyLayers() noexcept {
+    // keep exactly one empty layer on top
+    while (sl_layers > 2 && head->next[sl_layers - 2] == tail) {
+        sl_layers--;
+    }
+}
 
-    bottom_tail->prev = bottom_l;
-    bottom_tail->up = top_tail;
-    bottom_tail->next = nullptr;
-    bottom_tail->name = "bottom_tail";
 
-    bottom_l->next = bottom_tail;
-    bottom_l->up = top_l;
-    bottom_l->name = "bottom_l";
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::SkipList(): SkipList(Alloc()) {}
 
-    sl_size = 0;
-    sl_layers = 2;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::SkipList(const Alloc & alloc): SkipList(LevelGen(), alloc) {}
 
-}
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::SkipList(const LevelGen & levels, const Alloc & alloc): SkipList(Compare(), levels, alloc) {}
 
-template<typename Key, typename Value>
-SkipList<Key, Value>::~SkipList() {
-    // you need to cycle through every node that was created and delete it
-    Node* column = top_l;
-    Node* row;
-    Node* del;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::SkipList(const Compare & comp, const LevelGen & levels, const Alloc & alloc):
+        node_alloc(alloc), level_gen(levels), key_less(comp) {
+    head = makeNode(MAX_LAYERS);
+    try {
+        tail = makeNode(1);
+    } catch (...) {
+        destroyNode(head);
+        throw;
+    }
+#ifdef SKIPLIST_DEBUG_NAMES
+    head->name = "head";
+    tail->name = "tail";
+#endif
 
-    // reengineered
-    while (column != nullptr){
-        if (column->next->sentinel == true){
-            column = column->down;
-        } else {
-            row = column->next;
-            while (!row->sentinel){
-                    del = row;
-                    row = row->next;
-                    delete del;
-            }
-            column = column->down;
+    for (unsigned i = 0; i < MAX_LAYERS; i++) {
+        head->next[i] = tail;
+        if constexpr (Ranked) {
+            spans(head)[i] = 1;
         }
     }
-    Node* col = top_l;
-    Node* tail = top_tail;
-    Node* del2;
+    tail->prev = head;
+
+    sl_size = 0;
+    sl_layers = 2;
+    fixed_max_layers = 0;
+
+}
 
-    while (col != nullptr){
-        del = col;
-        del2 = tail;
-        col = col->down;
-        tail = tail->down;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename InputIt>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::SkipList(InputIt first, InputIt last, const Alloc & alloc): SkipList(alloc) {
+    assignSorted(first, last);
+}
 
-        delete del;
-        delete del2;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::~SkipList() {
+    if (releasesInBulk<SlotAlloc>::value && std::is_trivially_destructible<Node>::value) {
+        // the allocator hands back whole chunks when node_alloc goes away
+        return;
+    }
+    // every key owns exactly one node, so walking S_0 reaches all of them
+    Node* row = head->next[0];
+    Node* del;
 
+    while (row != tail){
+        del = row;
+        row = row->next[0];
+        destroyNode(del);
     }
+    destroyNode(head);
+    destroyNode(tail);
 }
 
-template<typename Key, typename Value>
-size_t SkipList<Key, Value>::size() const noexcept {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::size() const noexcept {
 	return sl_size;
 }
 
-template<typename Key, typename Value>
-bool SkipList<Key, Value>::isEmpty() const noexcept {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::isEmpty() const noexcept {
     if (sl_size == 0){return true;}
     return false;
 }
 
-template<typename Key, typename Value>
-unsigned SkipList<Key, Value>::numLayers() const noexcept {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::numLayers() const noexcept {
 	return sl_layers;
 }
 
-template<typename Key, typename Value>
-unsigned SkipList<Key, Value>::height(const Key & k) const {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::setMaxLayers(unsigned layers) {
+    if (layers == 1 || layers > MAX_LAYERS) {
+        throw RuntimeException("setMaxLayers: a list has 2 to " + std::to_string(MAX_LAYERS) + " layers.");
+    }
+    fixed_max_layers = layers;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::maxLayers() const noexcept {
+    return fixed_max_layers != 0 ? fixed_max_layers : maxLayersFor(sl_size);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::maxLayersFor(size_t n) noexcept {
+    return layerCapFor(n);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Alloc SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::get_allocator() const noexcept {
+    return Alloc(node_alloc);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::height(const Key & k) const {
     // search for the key, get key and return its height,
     // if false, then key didnt exist, raise exception
     Node* n;
@@ -395,28 +1413,29 @@ unsigned SkipList<Key, Value>::height(const Key & k) const {
     // throw exception
 }
 
-template<typename Key, typename Value>
-Key SkipList<Key, Value>::nextKey(const Key & k) const {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Key SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::nextKey(const Key & k) const {
     // search for the key, return k->next
     Node* n;
     if (search(k, n)){
-        if (n->next != nullptr && n->next->sentinel != true){
-            return n->next->key;
+        if (n->next[0] != tail){
+            return n->next[0]->kv.first;
         } else {
             throw RuntimeException("failed to get next key.");
             // throw exception if this occurs
         }
     }
+    throw RuntimeException("failed to get next key.");
     // no key found, throw exception
 }
 
-template<typename Key, typename Value>
-Key SkipList<Key, Value>::previousKey(const Key & k) const {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Key SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::previousKey(const Key & k) const {
      // search for the key, return k->prev
     Node* n;
     if (search(k, n)){
-        if (n->prev != nullptr && n->prev->sentinel != true){
-            return n->prev->key;
+        if (n->prev != head){
+            return n->prev->kv.first;
         } else {
             throw RuntimeException("No previous key");
             // throw exception if this occurs
@@ -426,158 +1445,1717 @@ Key SkipList<Key, Value>::previousKey(const Key & k) const {
     // no key found, throw exception
 }
 
-template<typename Key, typename Value>
-const Value & SkipList<Key, Value>::find(Key k) const {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+const Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::find(const Key & k) const {
     // search for the key, return k->val
     Node* n;
     if (search(k, n)){
-        // Value v = n->val;
-        // std::cout<<"found: key: "<<n->key<<" val: "<<v<<" height: "<<n->height<<std::endl;
-        return n->val;
+        return n->kv.second;
     }
     else {
         throw RuntimeException("find failed.");
-//        throw std::runtime_error("did not find");
         // no key found, throw exception}
     }
 }
 
-template<typename Key, typename Value>
-Value & SkipList<Key, Value>::find(const Key & k) {
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::find(const Key & k) {
     // search for the key, return k->val
     Node* n;
     if (search(k, n)){
-        // Value v = n->val;
-        // std::cout<<"found: key: "<<n->key<<" val: "<<v<<" height: "<<n->height<<std::endl;
-        // return static_cast<unsigned int &>(v);
-        return n->val;
+        return n->kv.second;
     }
     else {
         throw RuntimeException("find failed.");
-//        throw std::runtime_error("did not find");
         // no key found, throw exception}
     }
 }
 
-template<typename Key, typename Value>
-bool SkipList<Key, Value>::insert(const Key & k, const Value & v) {
-	// TODO - your implementation goes here!
-    Node* position;
-
-    if (sl_size == 0){
-        // if list is empty, position must start at bottom_l
-        position = bottom_l;
-    } else {
-        if (!search(k,position)){
-            // key didn't exist in list, position is now the node
-            // that is prev to where the key should be placed
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::contains(const Key & k) const {
+    Node* n;
+    return search(k, n);
+}
 
-            // position = location
-        } else {
-            // key exists in list, we cannot insert
-            // throw exception
-            return false;}
-    }
-    Node* newNode = new Node(k,v);
-    // placing new node where prev node was in 0 layer
-    // position -> newNode -> position->next
-    newNode->next = position->next;
-    newNode->prev = position;
-    position->next->prev = newNode;
-    position->next = newNode;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Value * SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryFind(const Key & k) {
+    Node* n;
+    return search(k, n) ? &n->kv.second : nullptr;
+}
 
-    newNode->height = 1;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+const Value * SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryFind(const Key & k) const {
+    Node* n;
+    return search(k, n) ? &n->kv.second : nullptr;
+}
 
-    // layer using coinflip
-    unsigned int currLayer = 0;
-    // while heads, increment upward from position
-    Node* temp = newNode;
-    unsigned int max = 3 * static_cast<int>(std::ceil(std::log2(sl_size + 1))) + 1;
-    if (sl_size < 16){
-        max = 13;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::find(const K & k) {
+    Node* n;
+    if (searchFor(k, n)) {
+        return n->kv.second;
     }
-    while(flipCoin(k,currLayer) && static_cast<unsigned int>(sl_layers) < max) {
-        if (currLayer + 1 >= static_cast<unsigned int>(sl_layers) - 1) {
-            Node* newTop = new Node();
-            Node* newTail = new Node();
-            newTop->next = newTail;
-            newTail->prev = newTop;
-
-            newTop->down = top_l;
-            top_l->up = newTop;
-            newTail->down = top_tail;
-            top_tail->up = newTail;
-
-            top_l = newTop;
-            top_tail = newTail;
-
-            sl_layers++;
-
-        }
-        // checks if the position we are replacing exists in that layer,
-        // if not, then we look for the position prev to it, if all else fails
-        // we obtain the bottom_l->up position
-        temp = position->next;
-        while (position->up == nullptr) {
-            position = position->prev;
-        }
-        position = position->up;
+    throw RuntimeException("find failed.");
+}
 
-        // finally pushing up the layer with desired insert
-        Node* newUp = new Node(k,v);
-        newUp->height = ++currLayer + 1;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+const Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::find(const K & k) const {
+    Node* n;
+    if (searchFor(k, n)) {
+        return n->kv.second;
+    }
+    throw RuntimeException("find failed.");
+}
 
-        newUp->next = position->next;
-        position->next->prev = newUp;
-        newUp->prev = position;
-        position->next = newUp;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::contains(const K & k) const {
+    Node* n;
+    return searchFor(k, n);
+}
 
-        newUp->down = temp;
-        temp->up = newUp;
-        temp = newUp;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+Value * SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryFind(const K & k) {
+    Node* n;
+    return searchFor(k, n) ? &n->kv.second : nullptr;
+}
 
-        newNode->height = newUp->height;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+const Value * SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryFind(const K & k) const {
+    Node* n;
+    return searchFor(k, n) ? &n->kv.second : nullptr;
+}
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node*>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findManyNodes(const std::vector<Key> & keys) const {
+    // one search in progress: where it is, and which key it is after
+    struct Descent {
+        Node* at;
+        unsigned layer;
+        size_t index;
+    };
+    std::vector<Node*> found(keys.size(), nullptr);
+    Descent group[FIND_MANY_GROUP];
+    unsigned active = 0;
+    size_t started = 0;
+    auto start = [&](Descent & d) {
+        SKIPLIST_STAT(searches, 1);
+        d.at = head;
+        d.layer = sl_layers - 2;
+        d.index = started++;
+        SKIPLIST_PREFETCH(head->next[d.layer]);
+    };
+    while (active < FIND_MANY_GROUP && started < keys.size()) {
+        start(group[active++]);
     }
 
-    sl_size++;
-
-    return true;
+    // each pass moves every search one step, so by the time a search comes
+    // round again the node it prefetched has had a whole pass to arrive
+    while (active > 0) {
+        for (unsigned i = 0; i < active;) {
+            Descent & d = group[i];
+            const auto & k = probeFor(keys[d.index]);
+            Node* nxt = d.at->next[d.layer];
+            if (before(nxt, k)) {
+                SKIPLIST_STAT(horizontalSteps, 1);
+                d.at = nxt;
+                SKIPLIST_PREFETCH(nxt->next[d.layer]);
+                prefetchBelow(nxt, d.layer);
+                i++;
+                continue;
+            }
+            bool hit = matches(nxt, k);
+            if (!hit && d.layer > 0) {
+                SKIPLIST_STAT(verticalSteps, 1);
+                d.layer--;
+                i++;
+                continue;
+            }
+            // done: hand the slot to the next key, or close the gap
+            if (hit) {
+                found[d.index] = nxt;
+            }
+            if (started < keys.size()) {
+                start(d);
+                i++;
+            } else {
+                d = group[--active];
+            }
+        }
+    }
+    return found;
 }
 
-template<typename Key, typename Value>
-std::vector<Key> SkipList<Key, Value>::allKeysInOrder() const {
-    Node* temp = bottom_l->next;
-    std::vector<Key> v;
-    // remember you made a sentinel for the bottom_tail
-    while (temp != bottom_tail){
-        v.push_back(temp->key);
-        temp = temp->next;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<Value*> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findMany(const std::vector<Key> & keys) {
+    std::vector<Node*> nodes = findManyNodes(keys);
+    std::vector<Value*> values(nodes.size(), nullptr);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] != nullptr) {
+            values[i] = &nodes[i]->kv.second;
+        }
     }
-    return v;
+    return values;
 }
 
-template<typename Key, typename Value>
-bool SkipList<Key, Value>::isSmallestKey(const Key & k) const {
-    // how can we check the whole list to see if the key exists with theta(1) time, at best it would be log(n)
-    if (k == bottom_l->next->key){
-        return true;
-    } else {
-        return false;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<const Value*> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findMany(const std::vector<Key> & keys) const {
+    std::vector<Node*> nodes = findManyNodes(keys);
+    std::vector<const Value*> values(nodes.size(), nullptr);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] != nullptr) {
+            values[i] = &nodes[i]->kv.second;
+        }
     }
+    return values;
 }
 
-template<typename Key, typename Value>
-bool SkipList<Key, Value>::isLargestKey(const Key & k) const {
-    // how can we check the whole list to see if the key exists with theta(1) time
-	if (k == bottom_tail->prev->key){
-        return true;
-    } else {
-        return false;
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::optional<Key> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryNextKey(const Key & k) const {
+    Node* n;
+    if (search(k, n) && n->next[0] != tail) {
+        return n->next[0]->kv.first;
     }
+    return std::nullopt;
 }
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::optional<Key> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryPreviousKey(const Key & k) const {
+    Node* n;
+    if (search(k, n) && n->prev != head) {
+        return n->prev->kv.first;
+    }
+    return std::nullopt;
+}
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::towerHeight(const Key & k, unsigned & layers) {
+    unsigned max = maxLayers();
+    unsigned h = level_gen(k, sl_layers, max);
+    if (h < 1) {
+        h = 1;
+    } else if (h > MAX_LAYERS - 1) {
+        h = MAX_LAYERS - 1;
+    }
+    SKIPLIST_STAT(inserts, 1);
+    SKIPLIST_STAT(promotions, h - 1);
+    // the generators stop one short of max, leaving room for the empty top layer
+    SKIPLIST_STAT(capHits, h + 1 >= max ? 1 : 0);
+    // there is always one empty layer above the tallest tower
+    layers = h + 1 > sl_layers ? h + 1 : sl_layers;
+    return h;
+}
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::linkTower(Node* newNode, Node ** update, unsigned layers, size_t * rank) {
+    // a new empty top layer only needs head's link, which already points at tail
+    for (unsigned i = sl_layers; i < layers; i++) {
+        update[i] = head;
+        if constexpr (Ranked) {
+            rank[i] = 0;
+            spans(head)[i] = sl_size + 1;
+        }
+    }
+    sl_layers = layers;
+
+    // splice the tower in after its predecessor on every layer it occupies
+    for (unsigned i = 0; i < newNode->height; i++) {
+        newNode->next[i] = update[i]->next[i];
+        update[i]->next[i] = newNode;
+        if constexpr (Ranked) {
+            // update[i] is rank[0] - rank[i] keys short of the new one
+            size_t gap = rank[0] - rank[i];
+            spans(newNode)[i] = spans(update[i])[i] - gap;
+            spans(update[i])[i] = gap + 1;
+        }
+    }
+    if constexpr (Ranked) {
+        // links that jump over the new tower cover one more key
+        for (unsigned i = newNode->height; i < sl_layers; i++) {
+            spans(update[i])[i]++;
+        }
+    }
+    newNode->prev = update[0];
+    newNode->next[0]->prev = newNode;
+
+    sl_size++;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insert(const Key & k, const Value & v) {
+    // if the key exists in list, we cannot insert
+    return tryEmplaceImpl(k, v).second;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insert(Key && k, Value && v) {
+    return tryEmplaceImpl(std::move(k), std::move(v)).second;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename... Args>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::emplace(Args&&... args) {
+    // the key is needed before the node can be sized, so build the pair first
+    std::pair<Key, Value> kv(std::forward<Args>(args)...);
+    return tryEmplaceImpl(std::move(kv.first), std::move(kv.second));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename... Args>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::try_emplace(const Key & k, Args&&... args) {
+    return tryEmplaceImpl(k, std::forward<Args>(args)...);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename... Args>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::try_emplace(Key && k, Args&&... args) {
+    return tryEmplaceImpl(std::move(k), std::forward<Args>(args)...);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename V>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insert_or_assign(const Key & k, V && v) {
+    return assignImpl(k, std::forward<V>(v));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename V>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insert_or_assign(Key && k, V && v) {
+    return assignImpl(std::move(k), std::forward<V>(v));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename Factory>
+Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findOrInsert(const Key & k, Factory && factory) {
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    Node* position = findPredecessors(k, update, rank);
+
+    if (matches(position->next[0], k)){
+        return position->next[0]->kv.second;
+    }
+
+    unsigned layers;
+    unsigned h = towerHeight(k, layers);
+    Node* newNode = makeTower(h, k, std::forward<Factory>(factory)());
+    linkTower(newNode, update, layers, rank);
+    return newNode->kv.second;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::operator[](const Key & k) {
+    return tryEmplaceImpl(k).first->second;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Value & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::operator[](Key && k) {
+    return tryEmplaceImpl(std::move(k)).first->second;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename... Args>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::tryEmplaceImpl(K && k, Args&&... args) {
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    Node* position = findPredecessors(k, update, rank);
+
+    if (matches(position->next[0], k)){
+        return std::make_pair(iterator(position->next[0]), false);
+    }
+
+    unsigned layers;
+    unsigned h = towerHeight(k, layers);
+    Node* newNode = makeTower(h, std::piecewise_construct,
+            std::forward_as_tuple(std::forward<K>(k)), std::forward_as_tuple(std::forward<Args>(args)...));
+    linkTower(newNode, update, layers, rank);
+    return std::make_pair(iterator(newNode), true);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename V>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, bool> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignImpl(K && k, V && v) {
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    Node* position = findPredecessors(k, update, rank);
+
+    if (matches(position->next[0], k)){
+        position->next[0]->kv.second = std::forward<V>(v);
+        return std::make_pair(iterator(position->next[0]), false);
+    }
+
+    unsigned layers;
+    unsigned h = towerHeight(k, layers);
+    Node* newNode = makeTower(h, std::forward<K>(k), std::forward<V>(v));
+    linkTower(newNode, update, layers, rank);
+    return std::make_pair(iterator(newNode), true);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node* SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::fingerPredecessors(
+        Node* from, const Key & k, Node ** update, unsigned & filled) const {
+    if (from == tail || from == head || !keyLess(from->kv.first, k)) {
+        // only forward moves are cheap, anything else is a normal descent
+        filled = sl_layers;
+        return findPredecessors(k, update);
+    }
+
+    // climb: use the tallest tower seen so far while it stays short of k
+    const auto & key = probeFor(k);
+    Node* temp = from;
+    unsigned layer = 0;
+    while (true) {
+        while (layer + 1 < temp->height && before(temp->next[layer + 1], key)) {
+            layer++;
+        }
+        Node* nxt = temp->next[layer];
+        if (before(nxt, key)) {
+            temp = nxt;
+        } else {
+            break;
+        }
+    }
+    // then descend exactly like findPredecessors
+    filled = layer + 1;
+    for (unsigned l = filled; l-- > 0;) {
+        Node* nxt = temp->next[l];
+        while (before(nxt, key)) {
+            temp = nxt;
+            nxt = temp->next[l];
+        }
+        update[l] = temp;
+    }
+    return temp;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::completePredecessors(Node ** update, unsigned filled, unsigned levels) const {
+    // nothing between update[filled - 1] and the key reaches layer `filled`,
+    // so each higher predecessor is the closest node at or before it that
+    // is tall enough
+    Node* y = update[filled - 1];
+    for (unsigned l = filled; l < levels; l++) {
+        while (y->height <= l) {
+            y = y->prev;
+        }
+        update[l] = y;
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const_iterator hint, const Key & k) {
+    Node* update[MAX_LAYERS];
+    unsigned filled;
+    return iterator(fingerPredecessors(hint.node, k, update, filled)->next[0]);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const_iterator hint, const Key & k) const {
+    Node* update[MAX_LAYERS];
+    unsigned filled;
+    return const_iterator(fingerPredecessors(hint.node, k, update, filled)->next[0]);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findNear(const_iterator hint, const Key & k) {
+    iterator it = lower_bound(hint, k);
+    if (matches(it.node, k)) {
+        return it;
+    }
+    return end();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::findNear(const_iterator hint, const Key & k) const {
+    const_iterator it = lower_bound(hint, k);
+    if (matches(it.node, k)) {
+        return it;
+    }
+    return end();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insert(const_iterator hint, const Key & k, const Value & v) {
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    unsigned filled;
+    Node* position;
+    if constexpr (Ranked) {
+        // linking needs the rank of every predecessor, which only a full
+        // descent provides
+        position = findPredecessors(k, update, rank);
+        filled = sl_layers;
+    } else {
+        position = fingerPredecessors(hint.node, k, update, filled);
+    }
+
+    if (matches(position->next[0], k)){
+        return iterator(position->next[0]);
+    }
+
+    unsigned layers;
+    unsigned h = towerHeight(k, layers);
+    Node* newNode = makeTower(h, k, v);
+    completePredecessors(update, filled, h);
+    linkTower(newNode, update, layers, rank);
+    return iterator(newNode);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::begin() noexcept {
+    return iterator(head->next[0]);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::end() noexcept {
+    return iterator(tail);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::begin() const noexcept {
+    return const_iterator(head->next[0]);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::end() const noexcept {
+    return const_iterator(tail);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::middle() const {
+    if (sl_size == 0) {
+        return end();
+    }
+    if constexpr (Ranked) {
+        return lower_bound(keyAtRank(sl_size / 2));
+    } else {
+        std::vector<Node*> starts = chunkStarts(2);
+        Node* n = starts.size() > 2 ? starts[1] : head->next[0];
+        if (n == head->next[0] && sl_size >= 2) {
+            n = n->next[0];
+        }
+        return const_iterator(n);
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::cbegin() const noexcept {
+    return begin();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::cend() const noexcept {
+    return end();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::reverse_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::rbegin() noexcept {
+    return reverse_iterator(end());
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::reverse_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::rend() noexcept {
+    return reverse_iterator(begin());
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_reverse_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::rbegin() const noexcept {
+    return const_reverse_iterator(end());
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_reverse_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::rend() const noexcept {
+    return const_reverse_iterator(begin());
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const Key & k) {
+    return iterator(lowerBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const Key & k) const {
+    return const_iterator(lowerBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::upper_bound(const Key & k) {
+    return iterator(upperBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::upper_bound(const Key & k) const {
+    return const_iterator(upperBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const K & k) {
+    return iterator(lowerBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::lower_bound(const K & k) const {
+    return const_iterator(lowerBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::upper_bound(const K & k) {
+    return iterator(upperBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename K, typename C, typename>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::upper_bound(const K & k) const {
+    return const_iterator(upperBoundNode(k));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator, typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::equal_range(const Key & k) {
+    Node* lower = lowerBoundNode(k);
+    Node* upper = matches(lower, k) ? lower->next[0] : lower;
+    return std::make_pair(iterator(lower), iterator(upper));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator, typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::const_iterator>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::equal_range(const Key & k) const {
+    Node* lower = lowerBoundNode(k);
+    Node* upper = matches(lower, k) ? lower->next[0] : lower;
+    return std::make_pair(const_iterator(lower), const_iterator(upper));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::erase(const Key & k) {
+    Node* update[MAX_LAYERS];
+    Node* position = findPredecessors(k, update);
+    Node* victim = position->next[0];
+
+    if (!matches(victim, k)) {
+        return false;
+    }
+    unlink(victim, update);
+    destroyNode(victim);
+    return true;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::iterator SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::erase(iterator pos) {
+    Node* victim = pos.node;
+    Node* after = victim->next[0];
+    Node* update[MAX_LAYERS];
+
+    if constexpr (Ranked) {
+        // every layer's predecessor is needed to fix the spans
+        findPredecessors(victim->kv.first, update);
+    } else {
+        predecessorsOf(victim, update);
+    }
+    unlink(victim, update);
+    destroyNode(victim);
+    return iterator(after);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Value SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::extract(const Key & k) {
+    Node* update[MAX_LAYERS];
+    Node* position = findPredecessors(k, update);
+    Node* victim = position->next[0];
+
+    if (!matches(victim, k)) {
+        throw RuntimeException("extract failed.");
+    }
+    Value v = std::move(victim->kv.second);
+    unlink(victim, update);
+    destroyNode(victim);
+    return v;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename InputIt>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insertBatch(InputIt first, InputIt last) {
+    std::vector<std::pair<Key, Value>> batch(first, last);
+    std::stable_sort(batch.begin(), batch.end(),
+            [this](const std::pair<Key, Value> & a, const std::pair<Key, Value> & b) { return keyLess(a.first, b.first); });
+    return insertSortedBatch(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename InputIt>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::insertSortedBatch(InputIt first, InputIt last) {
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    for (unsigned i = 0; i < MAX_LAYERS; i++) {
+        update[i] = head;
+        if constexpr (Ranked) {
+            rank[i] = 0;
+        }
+    }
+    size_t inserted = 0;
+
+    for (; first != last; ++first) {
+        // an rvalue (say, from a move_iterator) is moved into the node
+        auto && kv = *first;
+        const Key & k = kv.first;
+        Node* position;
+        if (update[0] != head && !keyLess(update[0]->kv.first, k)) {
+            // out of order (or the key we just linked): start from the top
+            position = findPredecessors(k, update, rank);
+        } else {
+            // every update[i] is still before k; on each layer continue from
+            // whichever is further along, it or what the layer above reached
+            Node* temp = head;
+            size_t r = 0;
+            for (unsigned layer = sl_layers; layer-- > 0;) {
+                Node* old = update[layer];
+                if (old != head && (temp == head || keyLess(temp->kv.first, old->kv.first))) {
+                    temp = old;
+                    if constexpr (Ranked) {
+                        r = rank[layer];
+                    }
+                }
+                Node* nxt = temp->next[layer];
+                while (before(nxt, k)) {
+                    if constexpr (Ranked) {
+                        r += spans(temp)[layer];
+                    }
+                    temp = nxt;
+                    nxt = temp->next[layer];
+                }
+                update[layer] = temp;
+                if constexpr (Ranked) {
+                    rank[layer] = r;
+                }
+            }
+            position = temp;
+        }
+
+        if (matches(position->next[0], k)){
+            continue;
+        }
+        unsigned layers;
+        unsigned h = towerHeight(k, layers);
+        Node* newNode = makeTower(h, std::forward<decltype(kv)>(kv).first, std::forward<decltype(kv)>(kv).second);
+        linkTower(newNode, update, layers, rank);
+        // the new tower is the closest predecessor of anything after it
+        size_t newRank = Ranked ? rank[0] + 1 : 0;
+        for (unsigned i = 0; i < h; i++) {
+            update[i] = newNode;
+            if constexpr (Ranked) {
+                rank[i] = newRank;
+            }
+        }
+        inserted++;
+    }
+    return inserted;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::beginAppend(Appender & a) const noexcept {
+    for (unsigned i = 0; i < MAX_LAYERS; i++) {
+        a.lastOn[i] = head;
+        if constexpr (Ranked) {
+            a.lastRank[i] = 0;
+        }
+    }
+    a.tallest = 1;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::append(Appender & a, Node* newNode) noexcept {
+    unsigned h = newNode->height;
+    sl_size++;
+    newNode->prev = a.lastOn[0];
+    for (unsigned i = 0; i < h; i++) {
+        a.lastOn[i]->next[i] = newNode;
+        newNode->next[i] = tail;
+        if constexpr (Ranked) {
+            spans(a.lastOn[i])[i] = sl_size - a.lastRank[i];
+            a.lastRank[i] = sl_size;
+        }
+        a.lastOn[i] = newNode;
+    }
+    tail->prev = newNode;
+    if (h > a.tallest) {
+        a.tallest = h;
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::endAppend(Appender & a) noexcept {
+    // one empty layer stays on top
+    sl_layers = a.tallest + 1;
+    if constexpr (Ranked) {
+        for (unsigned i = 0; i < sl_layers; i++) {
+            spans(a.lastOn[i])[i] = sl_size + 1 - a.lastRank[i];
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename InputIt>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignSorted(InputIt first, InputIt last) {
+    clear();
+    Appender a;
+    beginAppend(a);
+
+    try {
+        for (; first != last; ++first) {
+            auto && kv = *first;
+            const Key & k = kv.first;
+            Node* lastNode = a.lastOn[0];
+            if (lastNode != head && !keyLess(lastNode->kv.first, k)) {
+                if (!keyLess(k, lastNode->kv.first)) {
+                    continue;
+                }
+                throw RuntimeException("assignSorted: keys are not sorted.");
+            }
+            unsigned h = balancedHeight(sl_size + 1);
+            append(a, makeTower(h, std::forward<decltype(kv)>(kv).first, std::forward<decltype(kv)>(kv).second));
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+    endAppend(a);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::balancedHeight(size_t i) noexcept {
+    unsigned h = 1;
+    for (; (i & 1) == 0; i >>= 1) {
+        h++;
+    }
+    return h;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::appendCopy(Appender & a, const std::pair<const Key, Value> & kv) {
+    append(a, makeTower(balancedHeight(sl_size + 1), kv.first, kv.second));
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::merge(SkipList && other) {
+    if (&other == this) {
+        return;
+    }
+    bool sameAlloc = node_alloc == other.node_alloc;
+
+    // take both chains off their sentinels, then append the smaller front
+    // node until both are used up; every node keeps its tower
+    Node* x = head->next[0];
+    Node* y = other.head->next[0];
+    Node* const xEnd = tail;
+    Node* const yEnd = other.tail;
+    resetLinks();
+    other.resetLinks();
+    Appender a;
+    beginAppend(a);
+
+    try {
+        while (x != xEnd || y != yEnd) {
+            if (y == yEnd || (x != xEnd && keyLess(x->kv.first, y->kv.first))) {
+                Node* n = x;
+                x = x->next[0];
+                append(a, n);
+            } else if (x != xEnd && !keyLess(y->kv.first, x->kv.first)) {
+                // the same key in both: keep ours
+                Node* dup = y;
+                y = y->next[0];
+                other.destroyNode(dup);
+            } else if (sameAlloc) {
+                Node* n = y;
+                y = y->next[0];
+                other.tally.remove(n);
+                tally.add(n);
+                append(a, n);
+            } else {
+                Node* n = makeTower(y->height, y->kv.first, std::move(y->kv.second));
+                Node* old = y;
+                y = y->next[0];
+                other.destroyNode(old);
+                append(a, n);
+            }
+        }
+    } catch (...) {
+        // only makeTower throws, before y was touched: keep the rest of our
+        // chain and hand what is left of other's back to it
+        while (x != xEnd) {
+            Node* n = x;
+            x = x->next[0];
+            append(a, n);
+        }
+        endAppend(a);
+        Appender rest;
+        other.beginAppend(rest);
+        while (y != yEnd) {
+            Node* n = y;
+            y = y->next[0];
+            other.append(rest, n);
+        }
+        other.endAppend(rest);
+        throw;
+    }
+    endAppend(a);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignUnion(const SkipList & a, const SkipList & b) {
+    if (this == &a || this == &b) {
+        throw RuntimeException("assignUnion: the result cannot be an operand.");
+    }
+    clear();
+    Appender out;
+    beginAppend(out);
+    try {
+        Node* x = a.head->next[0];
+        Node* y = b.head->next[0];
+        while (x != a.tail || y != b.tail) {
+            if (y == b.tail || (x != a.tail && !keyLess(y->kv.first, x->kv.first))) {
+                if (y != b.tail && !keyLess(x->kv.first, y->kv.first)) {
+                    y = y->next[0]; // equal keys, a's wins
+                }
+                appendCopy(out, x->kv);
+                x = x->next[0];
+            } else {
+                appendCopy(out, y->kv);
+                y = y->next[0];
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+    endAppend(out);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignIntersection(const SkipList & a, const SkipList & b) {
+    if (this == &a || this == &b) {
+        throw RuntimeException("assignIntersection: the result cannot be an operand.");
+    }
+    clear();
+    Appender out;
+    beginAppend(out);
+    try {
+        Node* x = a.head->next[0];
+        Node* y = b.head->next[0];
+        while (x != a.tail && y != b.tail) {
+            if (keyLess(x->kv.first, y->kv.first)) {
+                x = x->next[0];
+            } else if (keyLess(y->kv.first, x->kv.first)) {
+                y = y->next[0];
+            } else {
+                appendCopy(out, x->kv);
+                x = x->next[0];
+                y = y->next[0];
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+    endAppend(out);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignDifference(const SkipList & a, const SkipList & b) {
+    if (this == &a || this == &b) {
+        throw RuntimeException("assignDifference: the result cannot be an operand.");
+    }
+    clear();
+    Appender out;
+    beginAppend(out);
+    try {
+        Node* x = a.head->next[0];
+        Node* y = b.head->next[0];
+        while (x != a.tail) {
+            if (y == b.tail || keyLess(x->kv.first, y->kv.first)) {
+                appendCopy(out, x->kv);
+                x = x->next[0];
+            } else if (keyLess(y->kv.first, x->kv.first)) {
+                y = y->next[0];
+            } else {
+                x = x->next[0];
+                y = y->next[0];
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+    endAppend(out);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::split(const Key & k, SkipList & upper) {
+    if (&upper == this) {
+        throw RuntimeException("split: upper cannot be this list.");
+    }
+    if (!(node_alloc == upper.node_alloc)) {
+        throw RuntimeException("split: the lists must share an allocator.");
+    }
+    upper.clear();
+
+    Node* update[MAX_LAYERS];
+    size_t rank[Ranked ? MAX_LAYERS : 1];
+    Node* last = findPredecessors(k, update, rank);
+    Node* first = last->next[0];
+    if (first == tail) {
+        return;
+    }
+
+    size_t moved;
+    if constexpr (Ranked) {
+        moved = sl_size - rank[0];
+    } else {
+        moved = 0;
+        for (Node* n = first; n != tail; n = n->next[0]) {
+            moved++;
+        }
+    }
+
+    // the moved nodes already end at our tail, so upper takes it over and
+    // our side is closed off with upper's (empty) one
+    Node* newTail = upper.tail;
+    for (unsigned i = 0; i < sl_layers; i++) {
+        upper.head->next[i] = update[i]->next[i];
+        update[i]->next[i] = newTail;
+        if constexpr (Ranked) {
+            // update[i]'s old link reached rank[i] + span; that key is now
+            // rank[i] + span - rank[0] in upper
+            spans(upper.head)[i] = rank[i] + spans(update[i])[i] - rank[0];
+            spans(update[i])[i] = rank[0] - rank[i] + 1;
+        }
+    }
+    for (unsigned i = sl_layers; i < MAX_LAYERS; i++) {
+        head->next[i] = newTail;
+        upper.head->next[i] = tail;
+    }
+    first->prev = upper.head;
+    newTail->prev = last;
+    upper.tail = tail;
+    tail = newTail;
+
+    // move the moved towers' share of the accounting over to upper,
+    // walking whichever side is shorter: the kept side can be counted
+    // into upper and the two tallies swapped, as the sentinels match
+    Node* from = sl_size - moved < moved ? head : upper.head;
+    Node* to = from == head ? tail : upper.tail;
+    for (Node* n = from->next[0]; n != to; n = n->next[0]) {
+        tally.remove(n);
+        upper.tally.add(n);
+    }
+    if (from == head) {
+        std::swap(tally, upper.tally);
+    }
+
+    upper.sl_size = moved;
+    upper.sl_layers = sl_layers;
+    sl_size -= moved;
+    dropEmptyLayers();
+    upper.dropEmptyLayers();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::save(std::ostream & out) const {
+    constexpr bool fixed = snapshotFixedWidth<Key, Value>();
+    using Record = SnapshotRecord<Key, Value>;
+
+    uint64_t offset = 0;
+    auto put = [&out, &offset](const void* p, size_t n) {
+        out.write(static_cast<const char*>(p), static_cast<std::streamsize>(n));
+        offset += n;
+    };
+    auto pad = [&put, &offset]() {
+        static const char zeros[SNAPSHOT_ALIGN] = {};
+        put(zeros, snapshotPadding(offset));
+    };
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.flags = fixed ? SNAPSHOT_FIXED_WIDTH : 0;
+    header.count = sl_size;
+    header.keyBytes = fixed ? sizeof(Key) : 0;
+    header.valueBytes = fixed ? sizeof(Value) : 0;
+    header.recordBytes = fixed ? sizeof(Record) : 0;
+    header.layers = sl_layers;
+    put(&header, sizeof(header));
+
+    for (Node* n = head->next[0]; n != tail; n = n->next[0]) {
+        unsigned char h = static_cast<unsigned char>(n->height);
+        put(&h, 1);
+    }
+    pad();
+
+    if constexpr (fixed) {
+        using Entry = SnapshotIndexEntry<Key>;
+        // records and index entries are zeroed first so padding bytes are
+        // deterministic
+        for (Node* n = head->next[0]; n != tail; n = n->next[0]) {
+            Record r;
+            std::memset(&r, 0, sizeof(r));
+            std::memcpy(&r.key, &n->kv.first, sizeof(Key));
+            std::memcpy(&r.value, &n->kv.second, sizeof(Value));
+            put(&r, sizeof(r));
+        }
+        pad();
+        for (unsigned layer = 1; layer + 1 < sl_layers; layer++) {
+            uint64_t count = 0;
+            for (Node* n = head->next[layer]; n != tail; n = n->next[layer]) {
+                count++;
+            }
+            put(&count, sizeof(count));
+            pad();
+            // walk the layer below alongside to find each tower's position there
+            Node* below = head->next[layer - 1];
+            uint64_t pos = 0;
+            for (Node* n = head->next[layer]; n != tail; n = n->next[layer]) {
+                while (below != n) {
+                    below = below->next[layer - 1];
+                    pos++;
+                }
+                Entry e;
+                std::memset(&e, 0, sizeof(e));
+                std::memcpy(&e.key, &n->kv.first, sizeof(Key));
+                e.down = pos;
+                put(&e, sizeof(e));
+            }
+            pad();
+        }
+    } else {
+        for (Node* n = head->next[0]; n != tail; n = n->next[0]) {
+            SnapshotCodec<Key>::write(out, n->kv.first);
+            SnapshotCodec<Value>::write(out, n->kv.second);
+        }
+    }
+    if (!out) {
+        throw RuntimeException("save: write failed.");
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::load(std::istream & in) {
+    constexpr bool fixed = snapshotFixedWidth<Key, Value>();
+    using Record = SnapshotRecord<Key, Value>;
+    clear();
+
+    uint64_t offset = 0;
+    auto get = [&in, &offset](void* p, size_t n) {
+        if (!in.read(static_cast<char*>(p), static_cast<std::streamsize>(n))) {
+            throw RuntimeException("load: snapshot is truncated.");
+        }
+        offset += n;
+    };
+    auto skip = [&in, &offset](uint64_t n) {
+        if (n > 0 && !in.ignore(static_cast<std::streamsize>(n))) {
+            throw RuntimeException("load: snapshot is truncated.");
+        }
+        offset += n;
+    };
+
+    SnapshotHeader header;
+    get(&header, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw RuntimeException("load: not a snapshot.");
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw RuntimeException("load: unsupported snapshot version.");
+    }
+    bool fixedFile = (header.flags & SNAPSHOT_FIXED_WIDTH) != 0;
+    if (fixedFile != fixed || (fixed && (header.keyBytes != sizeof(Key) ||
+            header.valueBytes != sizeof(Value) || header.recordBytes != sizeof(Record)))) {
+        throw RuntimeException("load: snapshot holds other key or value types.");
+    }
+
+    // read in pieces, so a corrupt count fails on the stream instead of
+    // allocating first
+    std::vector<unsigned char> heights;
+    for (uint64_t left = header.count; left > 0;) {
+        size_t n = left < 65536 ? static_cast<size_t>(left) : 65536;
+        heights.resize(heights.size() + n);
+        get(heights.data() + heights.size() - n, n);
+        left -= n;
+    }
+    skip(snapshotPadding(offset));
+
+    Appender a;
+    beginAppend(a);
+    try {
+        for (unsigned char h : heights) {
+            if (h == 0 || h >= MAX_LAYERS) {
+                throw RuntimeException("load: bad tower height.");
+            }
+            Node* newNode;
+            if constexpr (fixed) {
+                Record r;
+                get(&r, sizeof(r));
+                newNode = makeTower(h, r.key, r.value);
+            } else {
+                Key k = SnapshotCodec<Key>::read(in);
+                Value v = SnapshotCodec<Value>::read(in);
+                newNode = makeTower(h, std::move(k), std::move(v));
+            }
+            Node* lastNode = a.lastOn[0];
+            if (lastNode != head && !keyLess(lastNode->kv.first, newNode->kv.first)) {
+                destroyNode(newNode);
+                throw RuntimeException("load: keys are not sorted.");
+            }
+            append(a, newNode);
+        }
+        if constexpr (fixed) {
+            using Entry = SnapshotIndexEntry<Key>;
+            // the index is for SnapshotView; step over it so the stream
+            // ends up just past the snapshot
+            skip(snapshotPadding(offset));
+            for (unsigned layer = 1; layer + 1 < header.layers; layer++) {
+                uint64_t count;
+                get(&count, sizeof(count));
+                skip(snapshotPadding(offset));
+                skip(count * sizeof(Entry));
+                skip(snapshotPadding(offset));
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
+    }
+    endAppend(a);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+unsigned SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::workersFor(size_t n, unsigned threads) noexcept {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    size_t cap = n / MIN_KEYS_PER_THREAD;
+    if (threads > cap) {
+        threads = static_cast<unsigned>(cap);
+    }
+    return threads == 0 ? 1 : threads;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename F>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::runParallel(unsigned parts, F && fn) {
+    std::vector<std::exception_ptr> errors(parts);
+    auto run = [&fn, &errors](unsigned t) {
+        try {
+            fn(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    unsigned started = 1;
+    try {
+        workers.reserve(parts - 1);
+        for (; started < parts; started++) {
+            workers.emplace_back(run, started);
+        }
+    } catch (...) {
+        errors[started] = std::current_exception();
+    }
+    if (started == parts) {
+        run(0);
+    }
+    for (std::thread & w : workers) {
+        w.join();
+    }
+    for (std::exception_ptr & e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<typename SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::Node*>
+SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::chunkStarts(unsigned parts) const {
+    std::vector<Node*> starts;
+    starts.push_back(head->next[0]);
+    if (parts > 1) {
+        // the highest layer with a few towers per thread; walking it costs
+        // about as much as it has towers
+        size_t want = size_t(parts) * 8;
+        unsigned layer = 0;
+        size_t count = 0;
+        for (unsigned l = sl_layers - 1; l-- > 0;) {
+            count = 0;
+            for (Node* n = head->next[l]; n != tail && count < want; n = n->next[l]) {
+                count++;
+            }
+            if (count >= want) {
+                layer = l;
+                break;
+            }
+        }
+        count = 0;
+        for (Node* n = head->next[layer]; n != tail; n = n->next[layer]) {
+            count++;
+        }
+        // every (count / parts)-th tower starts a run
+        size_t seen = 0;
+        unsigned next = 1;
+        for (Node* n = head->next[layer]; n != tail && next < parts; n = n->next[layer]) {
+            if (seen++ == count * next / parts) {
+                if (n != starts.back()) {
+                    starts.push_back(n);
+                }
+                next++;
+            }
+        }
+    }
+    starts.push_back(tail);
+    return starts;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename F>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::forEachChunk(F && fn, unsigned threads) const {
+    std::vector<Node*> starts = chunkStarts(workersFor(sl_size, threads));
+    runParallel(static_cast<unsigned>(starts.size() - 1), [&](unsigned t) {
+        fn(t, starts[t], starts[t + 1]);
+    });
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename F>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::parallelForEach(F && fn, unsigned threads) {
+    forEachChunk([&fn](unsigned, Node* from, Node* to) {
+        for (Node* n = from; n != to; n = n->next[0]) {
+            prefetchAhead(n);
+            fn(n->kv);
+        }
+    }, threads);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename F>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::parallelForEach(F && fn, unsigned threads) const {
+    forEachChunk([&fn](unsigned, const Node* from, const Node* to) {
+        for (const Node* n = from; n != to; n = n->next[0]) {
+            prefetchAhead(n);
+            fn(static_cast<const std::pair<const Key, Value> &>(n->kv));
+        }
+    }, threads);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<Key> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::parallelAllKeysInOrder(unsigned threads) const {
+    // each run is collected on its own, then moved into place in parallel
+    std::vector<std::vector<Key>> runs(workersFor(sl_size, threads) + 1);
+    std::vector<size_t> offsets;
+    forEachChunk([&runs](unsigned t, Node* from, Node* to) {
+        for (Node* n = from; n != to; n = n->next[0]) {
+            prefetchAhead(n);
+            runs[t].push_back(n->kv.first);
+        }
+    }, threads);
+    size_t total = 0;
+    for (const std::vector<Key> & run : runs) {
+        offsets.push_back(total);
+        total += run.size();
+    }
+    std::vector<Key> keys(total);
+    runParallel(static_cast<unsigned>(runs.size()), [&](unsigned t) {
+        std::move(runs[t].begin(), runs[t].end(), keys.begin() + offsets[t]);
+    });
+    return keys;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+template<typename InputIt>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::assignParallel(InputIt first, InputIt last, unsigned threads) {
+    using Item = std::pair<Key, Value>;
+    std::vector<Item> items(first, last);
+    auto byKey = [this](const Item & a, const Item & b) { return keyLess(a.first, b.first); };
+
+    // sort runs in parallel, then merge neighbouring runs pairwise, also in
+    // parallel; both steps are stable, so the earliest of equal keys stays first
+    unsigned parts = workersFor(items.size(), threads);
+    std::vector<size_t> cuts;
+    for (unsigned t = 0; t <= parts; t++) {
+        cuts.push_back(items.size() * t / parts);
+    }
+    runParallel(parts, [&](unsigned t) {
+        std::stable_sort(items.begin() + cuts[t], items.begin() + cuts[t + 1], byKey);
+    });
+    while (cuts.size() > 2) {
+        std::vector<size_t> merged;
+        unsigned pairs = static_cast<unsigned>((cuts.size() - 1) / 2);
+        runParallel(pairs, [&](unsigned t) {
+            std::inplace_merge(items.begin() + cuts[2 * t], items.begin() + cuts[2 * t + 1],
+                               items.begin() + cuts[2 * t + 2], byKey);
+        });
+        for (size_t i = 0; i < cuts.size(); i += 2) {
+            merged.push_back(cuts[i]);
+        }
+        if (merged.back() != cuts.back()) {
+            merged.push_back(cuts.back());
+        }
+        cuts.swap(merged);
+    }
+    items.erase(std::unique(items.begin(), items.end(),
+            [this](const Item & a, const Item & b) { return !keyLess(a.first, b.first); }), items.end());
+
+    clear();
+    size_t n = items.size();
+    parts = workersFor(n, threads);
+
+    // each thread links keys [begin, end) into chains of its own on every
+    // layer; heights and ranks come from the global position
+    struct Piece {
+        Node* firstOn[MAX_LAYERS];
+        Node* lastOn[MAX_LAYERS];
+        size_t firstRank[MAX_LAYERS];
+        size_t lastRank[MAX_LAYERS];
+        unsigned tallest;
+        NodeTally counted;
+        std::exception_ptr error;
+    };
+    std::vector<Piece> pieces(parts);
+    for (Piece & p : pieces) {
+        for (unsigned l = 0; l < MAX_LAYERS; l++) {
+            p.firstOn[l] = nullptr;
+            p.lastOn[l] = nullptr;
+        }
+        p.tallest = 0;
+    }
+    // each piece catches its own errors, so this only throws when a thread
+    // cannot be started; pieces that never ran are empty
+    std::exception_ptr unstarted;
+    try {
+        runParallel(parts, [&](unsigned t) {
+            Piece & p = pieces[t];
+            try {
+                for (size_t i = n * t / parts; i < n * (t + 1) / parts; i++) {
+                    size_t rank = i + 1;
+                    unsigned h = balancedHeight(rank);
+                    Node* x = makeTowerIn(p.counted, h, std::move(items[i].first), std::move(items[i].second));
+                    x->prev = p.lastOn[0];
+                    for (unsigned l = 0; l < h; l++) {
+                        if (p.lastOn[l] == nullptr) {
+                            p.firstOn[l] = x;
+                            p.firstRank[l] = rank;
+                        } else {
+                            p.lastOn[l]->next[l] = x;
+                            if constexpr (Ranked) {
+                                spans(p.lastOn[l])[l] = rank - p.lastRank[l];
+                            }
+                        }
+                        p.lastOn[l] = x;
+                        p.lastRank[l] = rank;
+                    }
+                    if (h > p.tallest) {
+                        p.tallest = h;
+                    }
+                }
+            } catch (...) {
+                p.error = std::current_exception();
+            }
+        });
+    } catch (...) {
+        unstarted = std::current_exception();
+    }
+
+    for (Piece & p : pieces) {
+        tally.absorb(p.counted);
+    }
+    for (Piece & p : pieces) {
+        if (unstarted || p.error) {
+            // nothing is linked to head yet; free every piece's S_0 chain
+            for (Piece & q : pieces) {
+                for (Node* x = q.firstOn[0]; x != nullptr;) {
+                    Node* nxt = x == q.lastOn[0] ? nullptr : x->next[0];
+                    destroyNode(x);
+                    x = nxt;
+                }
+            }
+            std::rethrow_exception(unstarted ? unstarted : p.error);
+        }
+    }
+
+    // stitch the pieces together layer by layer, in key order
+    Appender a;
+    beginAppend(a);
+    for (Piece & p : pieces) {
+        for (unsigned l = 0; l < p.tallest; l++) {
+            if (p.firstOn[l] == nullptr) {
+                continue;
+            }
+            a.lastOn[l]->next[l] = p.firstOn[l];
+            if constexpr (Ranked) {
+                spans(a.lastOn[l])[l] = p.firstRank[l] - a.lastRank[l];
+                a.lastRank[l] = p.lastRank[l];
+            }
+            if (l == 0) {
+                p.firstOn[0]->prev = a.lastOn[0];
+            }
+            a.lastOn[l] = p.lastOn[l];
+        }
+        if (p.tallest > a.tallest) {
+            a.tallest = p.tallest;
+        }
+    }
+    for (unsigned l = 0; l <= a.tallest; l++) {
+        a.lastOn[l]->next[l] = tail;
+    }
+    tail->prev = a.lastOn[0];
+    sl_size = n;
+    endAppend(a);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::clear() noexcept {
+    Node* row = head->next[0];
+    while (row != tail) {
+        Node* del = row;
+        row = row->next[0];
+        destroyNode(del);
+    }
+    resetLinks();
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::resetLinks() noexcept {
+    for (unsigned i = 0; i < MAX_LAYERS; i++) {
+        head->next[i] = tail;
+        if constexpr (Ranked) {
+            spans(head)[i] = 1;
+        }
+    }
+    tail->prev = head;
+    sl_size = 0;
+    sl_layers = 2;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<Key> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::allKeysInOrder() const {
+    Node* temp = head->next[0];
+    std::vector<Key> v;
+    v.reserve(sl_size);
+    // remember you made a sentinel for the tail
+    while (temp != tail){
+        prefetchAhead(temp);
+        v.push_back(temp->kv.first);
+        temp = temp->next[0];
+    }
+    return v;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::vector<size_t> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::layerHistogram() const {
+    std::vector<size_t> counts(sl_layers, 0);
+    for (Node* n = head->next[0]; n != tail; n = n->next[0]) {
+        for (unsigned i = 0; i < n->height; i++) {
+            counts[i]++;
+        }
+    }
+    return counts;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipListStats SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::stats() const noexcept {
+#ifdef SKIPLIST_STATS
+    return op_stats;
+#else
+    return SkipListStats();
 #endif
+}
 
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+void SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::resetStats() noexcept {
+#ifdef SKIPLIST_STATS
+    op_stats = SkipListStats();
+#endif
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::bytesUsed() const noexcept {
+    return tally.nodeBytes + tally.keyHeapBytes;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::nodeCount() const noexcept {
+    return sl_size + 2;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+SkipListMemory SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::memoryUsage() const {
+    SkipListMemory m;
+    m.bytes = bytesUsed();
+    m.nodes = sl_size;
+    m.sentinels = 2;
+    m.sentinelBytes = (slotsFor(MAX_LAYERS) + slotsFor(1)) * sizeof(Slot);
+    m.keyBytes = sl_size * sizeof(Key) + tally.keyHeapBytes;
+    m.valueBytes = sl_size * sizeof(Value);
+    m.layerNodes.assign(sl_layers, 0);
+    // towers of height h occupy S_0 .. S_{h-1}, so S_i holds every tower
+    // taller than i
+    size_t taller = 0, links = 0;
+    for (unsigned h = MAX_LAYERS; h > 0; h--) {
+        taller += tally.heights[h];
+        links += tally.heights[h] * h;
+        if (h - 1 < sl_layers) {
+            m.layerNodes[h - 1] = taller;
+        }
+    }
+    m.linkBytes = links * (sizeof(Node*) + (Ranked ? sizeof(size_t) : 0));
+    m.overheadBytes = tally.nodeBytes - m.sentinelBytes - sl_size * (sizeof(Key) + sizeof(Value)) - m.linkBytes;
+    return m;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::rankOf(const Key & k) const {
+    static_assert(Ranked, "rankOf needs a Ranked SkipList");
+    Node* temp = head;
+    size_t r = 0;
+    for (unsigned layer = sl_layers; layer-- > 0;) {
+        Node* nxt = temp->next[layer];
+        while (before(nxt, k)) {
+            r += spans(temp)[layer];
+            temp = nxt;
+            nxt = temp->next[layer];
+        }
+    }
+    return r;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Key SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::keyAtRank(size_t i) const {
+    static_assert(Ranked, "keyAtRank needs a Ranked SkipList");
+    if (i >= sl_size) {
+        throw RuntimeException("keyAtRank: rank out of range.");
+    }
+    // the key sits at position i + 1, counting head as 0; tail is at
+    // sl_size + 1, so the walk never passes it
+    size_t target = i + 1;
+    Node* temp = head;
+    size_t r = 0;
+    for (unsigned layer = sl_layers; layer-- > 0;) {
+        while (r + spans(temp)[layer] <= target) {
+            r += spans(temp)[layer];
+            temp = temp->next[layer];
+        }
+        if (r == target) {
+            break;
+        }
+    }
+    return temp->kv.first;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+size_t SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::countInRange(const Key & a, const Key & b) const {
+    static_assert(Ranked, "countInRange needs a Ranked SkipList");
+    if (!keyLess(a, b)) {
+        return 0;
+    }
+    return rankOf(b) - rankOf(a);
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::isSmallestKey(const Key & k) const {
+    // the first key is checked directly; anything else has to be found to
+    // tell "not smallest" from "not there"
+    if (sl_size != 0 && sameKey(head->next[0]->kv.first, k)){
+        return true;
+    }
+    if (!contains(k)) {
+        throw RuntimeException("isSmallestKey: no key.");
+    }
+    return false;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+bool SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::isLargestKey(const Key & k) const {
+    if (sl_size != 0 && sameKey(tail->prev->kv.first, k)){
+        return true;
+    }
+    if (!contains(k)) {
+        throw RuntimeException("isLargestKey: no key.");
+    }
+    return false;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Key SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::minKey() const {
+    return front().first;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+Key SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::maxKey() const {
+    return back().first;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<const Key, Value> & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::front() {
+    if (sl_size == 0) {
+        throw RuntimeException("front: list is empty.");
+    }
+    return head->next[0]->kv;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+const std::pair<const Key, Value> & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::front() const {
+    if (sl_size == 0) {
+        throw RuntimeException("front: list is empty.");
+    }
+    return head->next[0]->kv;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<const Key, Value> & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::back() {
+    if (sl_size == 0) {
+        throw RuntimeException("back: list is empty.");
+    }
+    return tail->prev->kv;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+const std::pair<const Key, Value> & SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::back() const {
+    if (sl_size == 0) {
+        throw RuntimeException("back: list is empty.");
+    }
+    return tail->prev->kv;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<Key, Value> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::popFront() {
+    if (sl_size == 0) {
+        throw RuntimeException("popFront: list is empty.");
+    }
+    Node* victim = head->next[0];
+    Node* update[MAX_LAYERS];
+    for (unsigned i = 0; i < sl_layers; i++) {
+        update[i] = head;
+    }
+    std::pair<Key, Value> kv(victim->kv.first, std::move(victim->kv.second));
+    unlink(victim, update);
+    destroyNode(victim);
+    return kv;
+}
+
+template<typename Key, typename Value, typename Alloc, typename LevelGen, bool Ranked, typename Compare>
+std::pair<Key, Value> SkipList<Key, Value, Alloc, LevelGen, Ranked, Compare>::popBack() {
+    if (sl_size == 0) {
+        throw RuntimeException("popBack: list is empty.");
+    }
+    Node* victim = tail->prev;
+    std::pair<Key, Value> kv(victim->kv.first, std::move(victim->kv.second));
+    erase(iterator(victim));
+    return kv;
+}
+
+
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef __SNAPSHOT_FORMAT_HPP
+#define __SNAPSHOT_FORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include "runtimeexcept.hpp"
+
+// The binary snapshot written by SkipList::save and read back by
+// SkipList::load and SnapshotView. Everything is in the writer's native
+// byte order and layout, so a snapshot only moves between builds of the
+// same platform.
+//
+//     SnapshotHeader
+//     heights     count bytes, the tower height of each key in order
+//     records     the keys and values in increasing key order
+//     index       (fixed-width snapshots only) one array per layer S_1 ..
+//                 S_{layers - 2}, see below
+//
+// When both Key and Value are trivially copyable the snapshot is
+// "fixed-width": each record is a SnapshotRecord copied as is, and each
+// layer above S_0 follows as a uint64_t entry count and the entries
+// themselves, a SnapshotIndexEntry per tower reaching the layer. That is
+// the layout SnapshotView searches in place. Sections start on
+// SNAPSHOT_ALIGN byte boundaries so the mapped arrays are aligned.
+//
+// Otherwise each record is the key then the value, written by
+// SnapshotCodec: raw bytes for trivially copyable types, a uint64_t
+// length and the characters for std::string. There is no index, since
+// the records cannot be addressed without reading them.
+
+constexpr char SNAPSHOT_MAGIC[8] = {'S', 'K', 'I', 'P', 'L', 'I', 'S', 'T'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_FIXED_WIDTH = 1;
+constexpr size_t SNAPSHOT_ALIGN = 16;
+
+struct SnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t count;       // number of keys
+	uint32_t keyBytes;    // sizeof(Key), 0 unless fixed-width
+	uint32_t valueBytes;  // sizeof(Value), 0 unless fixed-width
+	uint32_t recordBytes; // sizeof(SnapshotRecord), 0 unless fixed-width
+	uint32_t layers;      // numLayers() of the saved list
+};
+
+template<typename Key, typename Value>
+struct SnapshotRecord
+{
+	Key key;
+	Value value;
+};
+
+// An entry on layer S_L (L >= 1): the tower's key, and where the same
+// tower sits on S_{L-1}, as an index into that layer's array (the record
+// index when L is 1).
+template<typename Key>
+struct SnapshotIndexEntry
+{
+	Key key;
+	uint64_t down;
+};
+
+template<typename Key, typename Value>
+constexpr bool snapshotFixedWidth()
+{
+	return std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value;
+}
+
+// Reads and writes one key or value of a variable-width snapshot.
+template<typename T, typename = void>
+struct SnapshotCodec
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+	              "snapshots support trivially copyable types and std::string");
+
+	static void write(std::ostream & out, const T & x)
+	{
+		out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+	}
+
+	static T read(std::istream & in)
+	{
+		T x;
+		if (!in.read(reinterpret_cast<char*>(&x), sizeof(T))) {
+			throw RuntimeException("snapshot is truncated.");
+		}
+		return x;
+	}
+};
+
+template<>
+struct SnapshotCodec<std::string>
+{
+	static void write(std::ostream & out, const std::string & s)
+	{
+		uint64_t len = s.size();
+		out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		out.write(s.data(), static_cast<std::streamsize>(len));
+	}
+
+	static std::string read(std::istream & in)
+	{
+		uint64_t len;
+		if (!in.read(reinterpret_cast<char*>(&len), sizeof(len))) {
+			throw RuntimeException("snapshot is truncated.");
+		}
+		// grow as the bytes arrive, so a corrupt length cannot make us
+		// allocate more than the stream holds
+		std::string s;
+		char buf[4096];
+		while (len > 0) {
+			size_t n = len < sizeof(buf) ? static_cast<size_t>(len) : sizeof(buf);
+			if (!in.read(buf, static_cast<std::streamsize>(n))) {
+				throw RuntimeException("snapshot is truncated.");
+			}
+			s.append(buf, n);
+			len -= n;
+		}
+		return s;
+	}
+};
+
+// Bytes of padding that bring `offset` to the next section boundary.
+inline size_t snapshotPadding(uint64_t offset) noexcept
+{
+	return static_cast<size_t>((SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __SNAPSHOT_VIEW_HPP
+#define __SNAPSHOT_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SnapshotFormat.hpp"
+#include "runtimeexcept.hpp"
+
+// SnapshotView -- read-only lookups straight from a memory-mapped snapshot.
+//
+// Opening a view maps the file written by SkipList::save and checks its
+// header; nothing is copied or rebuilt. Searches descend the per-layer
+// index arrays the snapshot carries, exactly as a SkipList descends its
+// towers, and land on the sorted record array. Pages are only read as the
+// searches touch them, so a warm start costs no more than the first few
+// lookups.
+//
+// Only fixed-width snapshots (trivially copyable Key and Value) can be
+// viewed. The view keeps the mapping alive until it is destroyed, and
+// pointers it returns point into the mapping. Compare must order the keys
+// as the saved list's Compare did.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class SnapshotView
+{
+public:
+	using Record = SnapshotRecord<Key, Value>;
+
+	// Map the snapshot at path. Throw a RuntimeException if it cannot be
+	// opened or is not a fixed-width snapshot of this Key and Value.
+	explicit SnapshotView(const std::string & path, const Compare & comp = Compare());
+
+	SnapshotView(const SnapshotView &) = delete;
+	SnapshotView & operator=(const SnapshotView &) = delete;
+
+	~SnapshotView();
+
+	// How many keys are in the snapshot?
+	size_t size() const noexcept { return count; }
+	bool isEmpty() const noexcept { return count == 0; }
+
+	// The layer count of the list that was saved.
+	unsigned numLayers() const noexcept { return layerCount; }
+
+	bool contains(const Key & k) const;
+
+	// The value for k, or nullptr if k is not in the snapshot.
+	const Value * tryFind(const Key & k) const;
+
+	// The value for k. Throw a RuntimeException if it does not exist.
+	const Value & find(const Key & k) const;
+
+	// The records in increasing key order, for scans.
+	const Record * begin() const noexcept { return records; }
+	const Record * end() const noexcept { return records + count; }
+
+	// The first record whose key is not less than k, or end().
+	const Record * lower_bound(const Key & k) const;
+
+private:
+	using Entry = SnapshotIndexEntry<Key>;
+
+	struct Layer
+	{
+		const Entry* entries;
+		uint64_t count;
+	};
+
+	[[noreturn]] void fail(const std::string & why);
+
+	void* base;
+	size_t length;
+	const Record* records;
+	uint64_t count;
+	unsigned layerCount;
+	std::vector<Layer> layers; // layers[0] is S_1
+	Compare less;
+};
+
+template<typename Key, typename Value, typename Compare>
+SnapshotView<Key, Value, Compare>::SnapshotView(const std::string & path, const Compare & comp)
+	: base(nullptr), length(0), records(nullptr), count(0), layerCount(0), less(comp)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw RuntimeException("SnapshotView: cannot open " + path + ".");
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+		::close(fd);
+		throw RuntimeException("SnapshotView: " + path + " is not a snapshot.");
+	}
+	length = static_cast<size_t>(st.st_size);
+	base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps the file
+	if (base == MAP_FAILED) {
+		base = nullptr;
+		throw RuntimeException("SnapshotView: cannot map " + path + ".");
+	}
+
+	const char* bytes = static_cast<const char*>(base);
+	SnapshotHeader header;
+	std::memcpy(&header, bytes, sizeof(header));
+	if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != SNAPSHOT_VERSION) {
+		fail("not a snapshot");
+	}
+	if ((header.flags & SNAPSHOT_FIXED_WIDTH) == 0 || header.keyBytes != sizeof(Key) ||
+			header.valueBytes != sizeof(Value) || header.recordBytes != sizeof(Record)) {
+		fail("holds other key or value types");
+	}
+	count = header.count;
+	layerCount = header.layers;
+
+	// every section is bounds-checked before it is used
+	uint64_t offset = sizeof(header);
+	auto section = [this, &offset](uint64_t n, uint64_t size) {
+		if (size != 0 && n > (length - offset) / size) {
+			fail("is truncated");
+		}
+		uint64_t start = offset;
+		offset += n * size;
+		offset += snapshotPadding(offset);
+		if (offset > length) {
+			offset = length;
+		}
+		return start;
+	};
+	section(count, 1); // heights, only needed to rebuild a SkipList
+	records = reinterpret_cast<const Record*>(bytes + section(count, sizeof(Record)));
+	for (unsigned layer = 1; layer + 1 < layerCount; layer++) {
+		uint64_t at = section(1, sizeof(uint64_t));
+		uint64_t n;
+		std::memcpy(&n, bytes + at, sizeof(n));
+		const Entry* entries = reinterpret_cast<const Entry*>(bytes + section(n, sizeof(Entry)));
+		layers.push_back(Layer{entries, n});
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+SnapshotView<Key, Value, Compare>::~SnapshotView()
+{
+	if (base != nullptr) {
+		::munmap(base, length);
+	}
+}
+
+template<typename Key, typename Value, typename Compare>
+void SnapshotView<Key, Value, Compare>::fail(const std::string & why)
+{
+	::munmap(base, length);
+	base = nullptr;
+	throw RuntimeException("SnapshotView: snapshot " + why + ".");
+}
+
+template<typename Key, typename Value, typename Compare>
+const typename SnapshotView<Key, Value, Compare>::Record * SnapshotView<Key, Value, Compare>::lower_bound(const Key & k) const
+{
+	// `from` is where the descent enters a layer: the position there of the
+	// last tower above whose key is less than k, or 0 coming from head
+	uint64_t from = 0;
+	for (size_t l = layers.size(); l-- > 0;) {
+		const Layer & layer = layers[l];
+		uint64_t i = from;
+		while (i < layer.count && less(layer.entries[i].key, k)) {
+			i++;
+		}
+		from = i > 0 ? layer.entries[i - 1].down : 0;
+		// the index is not checked when the file is mapped, so keep a
+		// corrupt one from sending the search off the end
+		uint64_t below = l > 0 ? layers[l - 1].count : count;
+		if (from > below) {
+			from = below;
+		}
+	}
+	uint64_t i = from;
+	while (i < count && less(records[i].key, k)) {
+		i++;
+	}
+	return records + i;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool SnapshotView<Key, Value, Compare>::contains(const Key & k) const
+{
+	return tryFind(k) != nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+const Value * SnapshotView<Key, Value, Compare>::tryFind(const Key & k) const
+{
+	const Record* r = lower_bound(k);
+	if (r != end() && !less(k, r->key)) {
+		return &r->value;
+	}
+	return nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+const Value & SnapshotView<Key, Value, Compare>::find(const Key & k) const
+{
+	const Value* v = tryFind(k);
+	if (v == nullptr) {
+		throw RuntimeException("find failed.");
+	}
+	return *v;
+}
+
+#endif
@@ -0,0 +1,535 @@
+// Throughput benchmarks for SkipList against std::map, absl::btree_map and
+// a sorted std::vector, using Google Benchmark. Build and run with
+//
+//     g++ -std=c++17 -O2 -DNDEBUG bench.cpp -o bench -lbenchmark -lpthread
+//         -labsl_throw_delegate -labsl_raw_logging_internal    (one line)
+//     ./bench --benchmark_filter=find_hit/SkipList
+//
+// Every benchmark is named op/container/key/distribution/size:
+//
+//   insert    build a container of `size` keys from empty, one key at a time
+//             (the sorted vector appends everything, then sorts once)
+//   find_hit  look up a key that is present
+//   find_miss look up a key that is not
+//   scan      lower_bound, then walk SCAN_LENGTH successors
+//   mixed     90% find_hit, 5% insert, 5% erase; the size stays put
+//   find_many (SkipList only) find_hit through findMany, FIND_BATCH keys
+//             per call
+//
+// Distributions pick which keys are inserted and probed: `sequential`
+// walks the key space in order, `uniform` draws uniformly, `zipf` draws
+// with YCSB's Zipfian skew (theta 0.99), so a few hot keys dominate.
+//
+// The SkipList rows use XorShiftLevels. SkipList_FlipCoin rows use the
+// default FlipCoinLevels, whose heights come from the key's bits: runs of
+// similar unsigned keys get the same towers (sequential finds are ~25x
+// slower at 10K keys), so those rows stop at FLIPCOIN_MAX_KEYS and are
+// there only to compare with the original behaviour.
+//
+// ns/op is reported as a counter next to the usual timings, and bytes/key
+// is everything the container took from its allocator divided by its size.
+// The string keys fit in libstdc++'s short-string buffer, so nothing is
+// hidden behind them.
+//
+// Sizes run from 1K to BENCH_MAX_KEYS, 1M by default. Define it as
+// 100000000 for the full range; that needs tens of GB and a lot of
+// patience.
+
+#include "SkipList.hpp"
+#include <absl/container/btree_map.h>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef BENCH_MAX_KEYS
+#define BENCH_MAX_KEYS 1000000
+#endif
+
+namespace {
+
+constexpr unsigned SCAN_LENGTH = 100;
+constexpr size_t FIND_BATCH = 64;
+constexpr size_t PROBES = 1 << 16;
+constexpr int64_t FLIPCOIN_MAX_KEYS = 10000;
+
+// Live bytes handed out by every CountingAllocator.
+size_t g_allocated = 0;
+
+template<typename T>
+class CountingAllocator
+{
+public:
+	using value_type = T;
+
+	CountingAllocator() noexcept = default;
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U> &) noexcept {}
+
+	T* allocate(size_t n)
+	{
+		g_allocated += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, size_t n) noexcept
+	{
+		g_allocated -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) noexcept { return true; }
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) noexcept { return false; }
+
+// ---------------------------------------------------------------------------
+// Keys. Key number i (i < n) is in the container; key number n + i is not.
+// Sequential keys interleave (2i hits, 2i + 1 misses) so misses land between
+// hits; random keys go through a bijection on 32 bits so they are distinct.
+
+enum class Dist { Sequential, Uniform, Zipf };
+
+const char* distName(Dist d)
+{
+	switch (d) {
+	case Dist::Sequential: return "sequential";
+	case Dist::Uniform: return "uniform";
+	default: return "zipf";
+	}
+}
+
+unsigned keyNumber(Dist d, uint64_t i, uint64_t n, bool hit)
+{
+	if (d == Dist::Sequential) {
+		return static_cast<unsigned>(2 * i + (hit ? 0 : 1));
+	}
+	uint32_t x = static_cast<uint32_t>(hit ? i : n + i);
+	// multiplication by an odd constant and xorshifts are both invertible
+	x *= 0x9E3779B1u;
+	x ^= x >> 16;
+	x *= 0x85EBCA6Bu;
+	x ^= x >> 13;
+	return x;
+}
+
+template<typename K> K makeKey(unsigned x);
+
+template<> unsigned makeKey<unsigned>(unsigned x) { return x; }
+
+template<> std::string makeKey<std::string>(unsigned x)
+{
+	char buf[16];
+	std::snprintf(buf, sizeof(buf), "key-%011u", x);
+	return buf;
+}
+
+const char* keyName(unsigned*) { return "unsigned"; }
+const char* keyName(std::string*) { return "string"; }
+
+uint64_t splitMix(uint64_t & x)
+{
+	uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// YCSB's Zipfian generator (Gray et al., "Quickly generating billion-record
+// synthetic databases"): rank 0 is the hottest.
+class ZipfIndex
+{
+public:
+	ZipfIndex(uint64_t n, uint64_t seed, double theta = 0.99)
+		: n(n), theta(theta), state(seed)
+	{
+		double zeta2 = zeta(2);
+		zetan = zeta(n);
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+	}
+
+	uint64_t operator()()
+	{
+		double u = (splitMix(state) >> 11) * (1.0 / 9007199254740992.0);
+		double uz = u * zetan;
+		if (uz < 1.0) {
+			return 0;
+		}
+		if (uz < 1.0 + std::pow(0.5, theta)) {
+			return 1;
+		}
+		uint64_t r = static_cast<uint64_t>(n * std::pow(eta * u - eta + 1.0, alpha));
+		return r < n ? r : n - 1;
+	}
+
+private:
+	double zeta(uint64_t count) const
+	{
+		double sum = 0;
+		for (uint64_t i = 1; i <= count; i++) {
+			sum += 1.0 / std::pow(static_cast<double>(i), theta);
+		}
+		return sum;
+	}
+
+	uint64_t n;
+	double theta, alpha, eta, zetan;
+	uint64_t state;
+};
+
+// The sequence of key numbers (in [0, n)) a distribution visits.
+class IndexStream
+{
+public:
+	IndexStream(Dist d, uint64_t n, uint64_t seed)
+		: dist(d), n(n), next(0), state(seed), zipf(d == Dist::Zipf ? new ZipfIndex(n, seed) : nullptr) {}
+
+	uint64_t operator()()
+	{
+		switch (dist) {
+		case Dist::Sequential: {
+			uint64_t i = next++;
+			if (next == n) { next = 0; }
+			return i;
+		}
+		case Dist::Uniform:
+			return splitMix(state) % n;
+		default:
+			return (*zipf)();
+		}
+	}
+
+private:
+	Dist dist;
+	uint64_t n, next, state;
+	std::unique_ptr<ZipfIndex> zipf;
+};
+
+// ---------------------------------------------------------------------------
+// Containers behind one interface.
+
+const char* skipListName() { return "SkipList"; }
+const char* flipCoinName() { return "SkipList_FlipCoin"; }
+
+template<typename K, typename LevelGen = XorShiftLevels, const char* (*Name)() = skipListName>
+struct SkipListAdapter
+{
+	static const char* name() { return Name(); }
+	SkipList<K, unsigned, CountingAllocator<std::pair<const K, unsigned>>, LevelGen> c;
+
+	void insert(const K & k, unsigned v) { c.insert(k, v); }
+	void finishInserts() {}
+	bool contains(const K & k) const { return c.contains(k); }
+	void erase(const K & k) { c.erase(k); }
+	size_t size() const { return c.size(); }
+	unsigned scan(const K & k, unsigned len) const
+	{
+		unsigned sum = 0;
+		for (auto it = c.lower_bound(k); it != c.end() && len-- > 0; ++it) { sum += it->second; }
+		return sum;
+	}
+};
+
+// std::map and absl::btree_map share an interface.
+template<typename Map, const char* (*Name)()>
+struct OrderedMapAdapter
+{
+	static const char* name() { return Name(); }
+	Map c;
+
+	void insert(const typename Map::key_type & k, unsigned v) { c.emplace(k, v); }
+	void finishInserts() {}
+	bool contains(const typename Map::key_type & k) const { return c.find(k) != c.end(); }
+	void erase(const typename Map::key_type & k) { c.erase(k); }
+	size_t size() const { return c.size(); }
+	unsigned scan(const typename Map::key_type & k, unsigned len) const
+	{
+		unsigned sum = 0;
+		for (auto it = c.lower_bound(k); it != c.end() && len-- > 0; ++it) { sum += it->second; }
+		return sum;
+	}
+};
+
+const char* stdMapName() { return "std_map"; }
+const char* btreeName() { return "absl_btree_map"; }
+
+template<typename K>
+using StdMapAdapter = OrderedMapAdapter<
+		std::map<K, unsigned, std::less<K>, CountingAllocator<std::pair<const K, unsigned>>>, stdMapName>;
+
+template<typename K>
+using BtreeAdapter = OrderedMapAdapter<
+		absl::btree_map<K, unsigned, std::less<K>, CountingAllocator<std::pair<const K, unsigned>>>, btreeName>;
+
+// Bulk inserts append and sort once in finishInserts; the mixed workload
+// uses true point inserts, which shift the tail of the vector.
+template<typename K>
+struct SortedVectorAdapter
+{
+	static const char* name() { return "sorted_vector"; }
+	using Entry = std::pair<K, unsigned>;
+	std::vector<Entry, CountingAllocator<Entry>> c;
+	bool loading = true;
+
+	static bool less(const Entry & a, const K & k) { return a.first < k; }
+
+	void insert(const K & k, unsigned v)
+	{
+		if (loading) {
+			c.emplace_back(k, v);
+			return;
+		}
+		auto it = std::lower_bound(c.begin(), c.end(), k, less);
+		if (it == c.end() || !(it->first == k)) { c.emplace(it, k, v); }
+	}
+
+	void finishInserts()
+	{
+		// stable, so the first of several equal keys survives, as in insert
+		std::stable_sort(c.begin(), c.end(), [](const Entry & a, const Entry & b) { return a.first < b.first; });
+		c.erase(std::unique(c.begin(), c.end(), [](const Entry & a, const Entry & b) { return a.first == b.first; }), c.end());
+		c.shrink_to_fit();
+		loading = false;
+	}
+
+	bool contains(const K & k) const
+	{
+		auto it = std::lower_bound(c.begin(), c.end(), k, less);
+		return it != c.end() && it->first == k;
+	}
+
+	void erase(const K & k)
+	{
+		auto it = std::lower_bound(c.begin(), c.end(), k, less);
+		if (it != c.end() && it->first == k) { c.erase(it); }
+	}
+
+	size_t size() const { return c.size(); }
+
+	unsigned scan(const K & k, unsigned len) const
+	{
+		unsigned sum = 0;
+		for (auto it = std::lower_bound(c.begin(), c.end(), k, less); it != c.end() && len-- > 0; ++it) { sum += it->second; }
+		return sum;
+	}
+};
+
+// ---------------------------------------------------------------------------
+// Loading. The read benchmarks for one (container, key, distribution, size)
+// run back to back and share a single loaded container; loading a different
+// one frees it first, so at most one big container is alive at a time.
+
+// Inserts key numbers 0 .. n-1 (ascending keys for sequential, random order
+// otherwise). With `skewed`, zipf instead draws n key numbers from its
+// distribution, repeats included, as a write-heavy hot set would.
+template<typename Adapter, typename K>
+void load(Adapter & a, Dist d, uint64_t n, bool skewed)
+{
+	IndexStream order(d, n, 42);
+	for (uint64_t i = 0; i < n; i++) {
+		uint64_t idx = skewed && d == Dist::Zipf ? order() : i;
+		a.insert(makeKey<K>(keyNumber(d, idx, n, true)), static_cast<unsigned>(idx));
+	}
+	a.finishInserts();
+}
+
+struct Loaded
+{
+	std::string id;
+	std::shared_ptr<void> container;
+	double bytesPerKey = 0;
+};
+
+Loaded g_loaded;
+
+template<typename Adapter, typename K>
+Adapter & loaded(Dist d, uint64_t n, double & bytesPerKey)
+{
+	std::string id = std::string(Adapter::name()) + "/" + keyName(static_cast<K*>(nullptr)) + "/" + distName(d) + "/" + std::to_string(n);
+	if (g_loaded.id != id) {
+		g_loaded = Loaded();
+		size_t before = g_allocated;
+		auto a = std::make_shared<Adapter>();
+		load<Adapter, K>(*a, d, n, false);
+		g_loaded.bytesPerKey = double(g_allocated - before) / a->size();
+		g_loaded.container = a;
+		g_loaded.id = id;
+	}
+	bytesPerKey = g_loaded.bytesPerKey;
+	return *static_cast<Adapter*>(g_loaded.container.get());
+}
+
+template<typename K>
+std::vector<K> probes(Dist d, uint64_t n, bool hit)
+{
+	IndexStream order(d, n, 7);
+	std::vector<K> keys;
+	keys.reserve(PROBES);
+	for (size_t i = 0; i < PROBES; i++) {
+		keys.push_back(makeKey<K>(keyNumber(d, order(), n, hit)));
+	}
+	return keys;
+}
+
+void report(benchmark::State & state, double bytesPerKey, uint64_t opsPerIteration)
+{
+	state.SetItemsProcessed(state.iterations() * opsPerIteration);
+	state.counters["ns/op"] = benchmark::Counter(double(state.iterations() * opsPerIteration),
+			benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+	state.counters["bytes/key"] = bytesPerKey;
+}
+
+// ---------------------------------------------------------------------------
+// The benchmarks.
+
+template<typename Adapter, typename K>
+void benchInsert(benchmark::State & state, Dist d)
+{
+	uint64_t n = state.range(0);
+	double bytesPerKey = 0;
+	for (auto _ : state) {
+		size_t before = g_allocated;
+		auto a = std::make_unique<Adapter>();
+		load<Adapter, K>(*a, d, n, true);
+		bytesPerKey = double(g_allocated - before) / a->size();
+		benchmark::DoNotOptimize(a->c);
+		state.PauseTiming(); // the teardown is not part of inserting
+		a.reset();
+		state.ResumeTiming();
+	}
+	report(state, bytesPerKey, n);
+}
+
+template<typename Adapter, typename K>
+void benchFind(benchmark::State & state, Dist d, bool hit)
+{
+	uint64_t n = state.range(0);
+	double bytesPerKey;
+	const Adapter & a = loaded<Adapter, K>(d, n, bytesPerKey);
+	std::vector<K> keys = probes<K>(d, n, hit);
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.contains(keys[i]));
+		i = (i + 1) % PROBES;
+	}
+	report(state, bytesPerKey, 1);
+}
+
+template<typename Adapter, typename K>
+void benchScan(benchmark::State & state, Dist d)
+{
+	uint64_t n = state.range(0);
+	double bytesPerKey;
+	const Adapter & a = loaded<Adapter, K>(d, n, bytesPerKey);
+	std::vector<K> keys = probes<K>(d, n, true);
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.scan(keys[i], SCAN_LENGTH));
+		i = (i + 1) % PROBES;
+	}
+	report(state, bytesPerKey, 1);
+}
+
+template<typename Adapter, typename K>
+void benchMixed(benchmark::State & state, Dist d)
+{
+	uint64_t n = state.range(0);
+	double bytesPerKey;
+	Adapter & a = loaded<Adapter, K>(d, n, bytesPerKey);
+	std::vector<K> keys = probes<K>(d, n, true);
+	// writes insert fresh keys (misses) and erase them again in FIFO order
+	std::vector<K> fresh = probes<K>(Dist::Uniform, n, false);
+	size_t i = 0, inserted = 0, erased = 0;
+	uint64_t dice = 1;
+	for (auto _ : state) {
+		unsigned roll = static_cast<unsigned>(splitMix(dice) % 20);
+		if (roll < 18 || (roll == 19 && erased == inserted)) {
+			benchmark::DoNotOptimize(a.contains(keys[i]));
+			i = (i + 1) % PROBES;
+		} else if (roll == 18) {
+			a.insert(fresh[inserted++ % PROBES], 0);
+		} else {
+			a.erase(fresh[erased++ % PROBES]);
+		}
+	}
+	// leave the shared container as it was loaded
+	while (erased < inserted) {
+		a.erase(fresh[erased++ % PROBES]);
+	}
+	report(state, bytesPerKey, 1);
+}
+
+template<typename K>
+void benchFindMany(benchmark::State & state, Dist d)
+{
+	uint64_t n = state.range(0);
+	double bytesPerKey;
+	const SkipListAdapter<K> & a = loaded<SkipListAdapter<K>, K>(d, n, bytesPerKey);
+	std::vector<K> keys = probes<K>(d, n, true);
+	std::vector<std::vector<K>> batches;
+	for (size_t i = 0; i + FIND_BATCH <= keys.size(); i += FIND_BATCH) {
+		batches.emplace_back(keys.begin() + i, keys.begin() + i + FIND_BATCH);
+	}
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a.c.findMany(batches[i]));
+		i = (i + 1) % batches.size();
+	}
+	report(state, bytesPerKey, FIND_BATCH);
+}
+
+template<typename Adapter, typename K>
+void registerContainer(int64_t maxKeys = BENCH_MAX_KEYS)
+{
+	const Dist dists[] = {Dist::Sequential, Dist::Uniform, Dist::Zipf};
+	for (int64_t n = 1000; n <= maxKeys; n *= 10) {
+		for (Dist d : dists) {
+			std::string suffix = std::string("/") + Adapter::name() + "/" + keyName(static_cast<K*>(nullptr)) + "/" + distName(d);
+			benchmark::RegisterBenchmark(("insert" + suffix).c_str(), benchInsert<Adapter, K>, d)->Arg(n);
+			benchmark::RegisterBenchmark(("find_hit" + suffix).c_str(), benchFind<Adapter, K>, d, true)->Arg(n);
+			benchmark::RegisterBenchmark(("find_miss" + suffix).c_str(), benchFind<Adapter, K>, d, false)->Arg(n);
+			benchmark::RegisterBenchmark(("scan" + suffix).c_str(), benchScan<Adapter, K>, d)->Arg(n);
+			benchmark::RegisterBenchmark(("mixed" + suffix).c_str(), benchMixed<Adapter, K>, d)->Arg(n);
+		}
+	}
+}
+
+template<typename K>
+void registerKey()
+{
+	registerContainer<SkipListAdapter<K>, K>();
+	registerContainer<SkipListAdapter<K, FlipCoinLevels, flipCoinName>, K>(std::min<int64_t>(FLIPCOIN_MAX_KEYS, BENCH_MAX_KEYS));
+	const Dist dists[] = {Dist::Sequential, Dist::Uniform, Dist::Zipf};
+	for (int64_t n = 1000; n <= BENCH_MAX_KEYS; n *= 10) {
+		for (Dist d : dists) {
+			std::string suffix = std::string("/SkipList/") + keyName(static_cast<K*>(nullptr)) + "/" + distName(d);
+			benchmark::RegisterBenchmark(("find_many" + suffix).c_str(), benchFindMany<K>, d)->Arg(n);
+		}
+	}
+	registerContainer<StdMapAdapter<K>, K>();
+	registerContainer<BtreeAdapter<K>, K>();
+	registerContainer<SortedVectorAdapter<K>, K>();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	registerKey<unsigned>();
+	registerKey<std::string>();
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
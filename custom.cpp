@@ -1,4 +1,19 @@
 #include "SkipList.hpp"
+#include "ArenaAllocator.hpp"
+#include "ConcurrentSkipList.hpp"
+#include "ShardedSkipList.hpp"
+#include "SnapshotView.hpp"
+#include "DurableSkipList.hpp"
+#include "MemtableSkipList.hpp"
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <sys/resource.h>
 #include "catch_amalgamated.hpp"
 
 namespace {
@@ -94,4 +109,1741 @@ namespace {
 		// (because the fast lane is not included in the height calculation).
 		REQUIRE(sl.numLayers() == 16);
 	}
-}
\ No newline at end of file
+
+	TEST_CASE("xTowerNeighborsTest", "[skip-list-tower]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 200; i++)
+		{
+			unsigned k = (i * 37) % 200;
+			REQUIRE( sl.insert(k, k * 2) );
+		}
+		REQUIRE( !sl.insert(17, 0) );
+		REQUIRE( sl.size() == 200 );
+
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		for (unsigned i = 0; i < 200; i++)
+		{
+			REQUIRE( keys[i] == i );
+			REQUIRE( sl.find(i) == i * 2 );
+		}
+		REQUIRE( sl.nextKey(41) == 42 );
+		REQUIRE( sl.previousKey(41) == 40 );
+		REQUIRE_THROWS( sl.nextKey(199) );
+		REQUIRE_THROWS( sl.previousKey(0) );
+		REQUIRE_THROWS( sl.nextKey(500) );
+		REQUIRE_THROWS( sl.find(500) );
+	}
+
+	TEST_CASE("xArenaAllocatorTest", "[skip-list-arena]")
+	{
+		using Alloc = ArenaAllocator<std::pair<const unsigned, unsigned>>;
+		SkipList<unsigned, unsigned, Alloc> sl{Alloc(4096)};
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			REQUIRE( sl.insert(i, i + 1) );
+		}
+		REQUIRE( sl.find(500) == 501 );
+		REQUIRE( sl.allKeysInOrder().size() == 1000 );
+		// nodes are packed into chunks rather than allocated one by one
+		REQUIRE( sl.get_allocator().arena().chunkCount() < 100 );
+
+		SkipList<std::string, std::string, ArenaAllocator<char>> strings;
+		strings.insert("Shindler", "ICS 46");
+		strings.insert("Klefstad", "ICS 45C");
+		REQUIRE( strings.find("Shindler") == "ICS 46" );
+		REQUIRE( strings.nextKey("Klefstad") == "Shindler" );
+	}
+
+	TEST_CASE("xConcurrentInsertTest", "[skip-list-concurrent]")
+	{
+		ConcurrentSkipList<unsigned, unsigned> sl;
+		const unsigned THREADS = 4;
+		const unsigned PER_THREAD = 2000;
+
+		std::vector<std::thread> writers;
+		for (unsigned t = 0; t < THREADS; t++)
+		{
+			writers.emplace_back([&sl, t, PER_THREAD, THREADS]() {
+				// interleaved keys so every writer contends for the same towers
+				for (unsigned i = 0; i < PER_THREAD; i++)
+				{
+					unsigned k = i * THREADS + t;
+					sl.insert(k, k + 1);
+				}
+			});
+		}
+		// Catch assertions are not thread-safe, so the reader only counts
+		unsigned badReads = 0;
+		std::thread reader([&sl, &badReads]() {
+			for (unsigned i = 0; i < 20000; i++)
+			{
+				unsigned k = (i * 7) % 8000;
+				if (sl.contains(k) && sl.find(k) != k + 1)
+				{
+					badReads++;
+				}
+			}
+		});
+		for (std::thread & w : writers)
+		{
+			w.join();
+		}
+		reader.join();
+
+		REQUIRE( badReads == 0 );
+		REQUIRE( sl.size() == THREADS * PER_THREAD );
+		REQUIRE( !sl.insert(17, 0) );
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		REQUIRE( keys.size() == THREADS * PER_THREAD );
+		for (unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE( keys[i] == i );
+		}
+		REQUIRE( sl.nextKey(41) == 42 );
+		REQUIRE( sl.previousKey(41) == 40 );
+		REQUIRE_THROWS( sl.find(THREADS * PER_THREAD) );
+	}
+
+	TEST_CASE("xEraseTest", "[skip-list-erase]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 10; i++)
+		{
+			sl.insert(i, i);
+		}
+		unsigned const MAGIC_VAL = 255;
+		sl.insert(MAGIC_VAL, MAGIC_VAL);
+		REQUIRE( sl.numLayers() == 13 );
+
+		// removing the tall tower drops the layers only it occupied
+		REQUIRE( sl.erase(MAGIC_VAL) );
+		REQUIRE( !sl.erase(MAGIC_VAL) );
+		REQUIRE( sl.numLayers() == 5 );
+		REQUIRE( sl.size() == 10 );
+
+		REQUIRE( sl.extract(3) == 3 );
+		REQUIRE_THROWS( sl.extract(3) );
+		REQUIRE_THROWS( sl.find(3) );
+		REQUIRE( sl.nextKey(2) == 4 );
+		REQUIRE( sl.previousKey(4) == 2 );
+		REQUIRE( sl.numLayers() == 5 );
+		REQUIRE( sl.insert(3, 30) );
+		REQUIRE( sl.find(3) == 30 );
+
+		for (unsigned i = 0; i < 10; i++)
+		{
+			REQUIRE( sl.erase(i) );
+		}
+		REQUIRE( sl.isEmpty() );
+		REQUIRE( sl.numLayers() == 2 );
+		REQUIRE( sl.begin() == sl.end() );
+	}
+
+	TEST_CASE("xEraseWhileScanningTest", "[skip-list-erase]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 500; i++)
+		{
+			sl.insert(i, i);
+		}
+		// evict every odd key in a single pass
+		for (SkipList<unsigned, unsigned>::iterator it = sl.begin(); it != sl.end(); )
+		{
+			if (it->first % 2 == 1)
+			{
+				it = sl.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		REQUIRE( sl.size() == 250 );
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		for (unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE( keys[i] == 2 * i );
+			REQUIRE( sl.find(2 * i) == 2 * i );
+			REQUIRE( !sl.erase(2 * i + 1) );
+		}
+	}
+
+	TEST_CASE("xConcurrentEraseTest", "[skip-list-concurrent]")
+	{
+		ConcurrentSkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 4000; i++)
+		{
+			sl.insert(i, i);
+		}
+		// two threads race to erase the same keys while two others insert new ones
+		unsigned erased[2] = {0, 0};
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < 2; t++)
+		{
+			workers.emplace_back([&sl, &erased, t]() {
+				for (unsigned i = 0; i < 4000; i += 2)
+				{
+					if (sl.erase(i))
+					{
+						erased[t]++;
+					}
+				}
+			});
+			workers.emplace_back([&sl, t]() {
+				for (unsigned i = 4000 + t; i < 8000; i += 2)
+				{
+					sl.insert(i, i);
+				}
+			});
+		}
+		for (std::thread & w : workers)
+		{
+			w.join();
+		}
+		REQUIRE( erased[0] + erased[1] == 2000 );
+		REQUIRE( sl.size() == 6000 );
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		REQUIRE( keys.size() == 6000 );
+		for (unsigned i = 0; i < 2000; i++)
+		{
+			REQUIRE( keys[i] == 2 * i + 1 );
+		}
+		REQUIRE( !sl.contains(0) );
+		REQUIRE( sl.nextKey(1) == 3 );
+	}
+
+	TEST_CASE("xBulkLoadTest", "[skip-list-bulk]")
+	{
+		std::vector<std::pair<unsigned, unsigned>> sorted;
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			sorted.emplace_back(i * 2, i);
+		}
+		SkipList<unsigned, unsigned> sl(sorted.begin(), sorted.end());
+		REQUIRE( sl.size() == 1000 );
+		// rank 1, 2, 3, 4, ... get heights 1, 2, 1, 3, ...
+		REQUIRE( sl.height(0) == 1 );
+		REQUIRE( sl.height(2) == 2 );
+		REQUIRE( sl.height(4) == 1 );
+		REQUIRE( sl.height(6) == 3 );
+		REQUIRE( sl.height(1022) == 10 );
+		REQUIRE( sl.numLayers() == 11 );
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			REQUIRE( sl.find(i * 2) == i );
+		}
+		REQUIRE( sl.previousKey(0 + 2) == 0 );
+		REQUIRE( sl.nextKey(1998 - 2) == 1998 );
+
+		// the built list behaves like any other
+		REQUIRE( sl.insert(7, 70) );
+		REQUIRE( sl.nextKey(6) == 7 );
+		REQUIRE( sl.erase(1022) );
+		REQUIRE( sl.numLayers() == 10 );
+
+		std::vector<std::pair<unsigned, unsigned>> unsorted = {{1, 1}, {3, 3}, {2, 2}};
+		REQUIRE_THROWS( sl.assignSorted(unsorted.begin(), unsorted.end()) );
+		REQUIRE( sl.isEmpty() );
+		REQUIRE( sl.numLayers() == 2 );
+	}
+
+	TEST_CASE("xIteratorRangeTest", "[skip-list-iterator]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 100; i++)
+		{
+			sl.insert(i * 10, i);
+		}
+
+		unsigned expected = 0;
+		for (std::pair<const unsigned, unsigned> & kv : sl)
+		{
+			REQUIRE( kv.first == expected * 10 );
+			kv.second += 1;
+			expected++;
+		}
+		REQUIRE( expected == 100 );
+		REQUIRE( sl.find(50) == 6 );
+
+		const SkipList<unsigned, unsigned> & csl = sl;
+		// keys in [205, 400)
+		std::vector<unsigned> range;
+		for (SkipList<unsigned, unsigned>::const_iterator it = csl.lower_bound(205); it != csl.lower_bound(400); ++it)
+		{
+			range.push_back(it->first);
+		}
+		std::vector<unsigned> expectedRange;
+		for (unsigned k = 210; k < 400; k += 10)
+		{
+			expectedRange.push_back(k);
+		}
+		REQUIRE( range == expectedRange );
+
+		REQUIRE( sl.lower_bound(210)->first == 210 );
+		REQUIRE( sl.upper_bound(210)->first == 220 );
+		REQUIRE( sl.upper_bound(990) == sl.end() );
+		REQUIRE( sl.lower_bound(991) == sl.end() );
+		REQUIRE( std::distance(sl.equal_range(210).first, sl.equal_range(210).second) == 1 );
+		REQUIRE( sl.equal_range(211).first == sl.equal_range(211).second );
+
+		SkipList<unsigned, unsigned>::const_iterator last = --csl.end();
+		REQUIRE( last->first == 990 );
+		REQUIRE( sl.rbegin()->first == 990 );
+		REQUIRE( (++sl.rbegin())->first == 980 );
+		REQUIRE( std::distance(csl.cbegin(), csl.cend()) == 100 );
+	}
+
+	TEST_CASE("xFingerSearchTest", "[skip-list-finger]")
+	{
+		SkipList<unsigned, unsigned> hinted;
+		SkipList<unsigned, unsigned> plain;
+		SkipList<unsigned, unsigned>::iterator hint = hinted.end();
+		for (unsigned i = 0; i < 2000; i++)
+		{
+			// mostly ascending with small steps back, like late samples
+			unsigned k = (i % 4 == 3) ? i * 3 - 5 : i * 3;
+			hint = hinted.insert(hint, k, i);
+			plain.insert(k, i);
+			REQUIRE( hint->first == k );
+		}
+		REQUIRE( hinted.size() == plain.size() );
+		REQUIRE( hinted.numLayers() == plain.numLayers() );
+		for (std::pair<const unsigned, unsigned> & kv : plain)
+		{
+			REQUIRE( hinted.find(kv.first) == kv.second );
+			REQUIRE( hinted.height(kv.first) == plain.height(kv.first) );
+		}
+
+		// an existing key is not overwritten
+		SkipList<unsigned, unsigned>::iterator existing = hinted.insert(hinted.begin(), 300, 0);
+		REQUIRE( existing->second == 100 );
+
+		SkipList<unsigned, unsigned>::iterator from = hinted.findNear(hinted.begin(), 30);
+		REQUIRE( from->first == 30 );
+		REQUIRE( hinted.findNear(from, 36)->first == 36 );
+		REQUIRE( hinted.findNear(from, 33) == hinted.end() );
+		REQUIRE( hinted.findNear(from, 0)->first == 0 );
+		REQUIRE( hinted.lower_bound(from, 5000)->first == 5004 );
+		REQUIRE( hinted.lower_bound(hinted.end(), 31)->first == 36 );
+	}
+
+	TEST_CASE("xBatchInsertTest", "[skip-list-batch]")
+	{
+		std::vector<std::pair<unsigned, unsigned>> batch;
+		for (unsigned i = 0; i < 3000; i++)
+		{
+			batch.emplace_back((i * 7919) % 3001, i);
+		}
+		batch.emplace_back(5, 12345); // duplicate, the earlier pair wins
+
+		SkipList<unsigned, unsigned> batched;
+		SkipList<unsigned, unsigned> looped;
+		for (unsigned i = 0; i < 500; i++)
+		{
+			batched.insert(i * 6, 0);
+			looped.insert(i * 6, 0);
+		}
+		size_t inserted = batched.insertBatch(batch.begin(), batch.end());
+		size_t expected = 0;
+		for (const std::pair<unsigned, unsigned> & kv : batch)
+		{
+			expected += looped.insert(kv.first, kv.second) ? 1 : 0;
+		}
+		REQUIRE( inserted == expected );
+		REQUIRE( batched.size() == looped.size() );
+		REQUIRE( batched.numLayers() == looped.numLayers() );
+		REQUIRE( batched.allKeysInOrder() == looped.allKeysInOrder() );
+		for (std::pair<const unsigned, unsigned> & kv : looped)
+		{
+			REQUIRE( batched.find(kv.first) == kv.second );
+		}
+
+		// a "sorted" batch that is not quite sorted still inserts everything
+		std::vector<std::pair<unsigned, unsigned>> almost = {{4000, 1}, {4002, 2}, {4001, 3}, {4003, 4}};
+		REQUIRE( batched.insertSortedBatch(almost.begin(), almost.end()) == 4 );
+		REQUIRE( batched.nextKey(4000) == 4001 );
+		REQUIRE( batched.nextKey(4001) == 4002 );
+	}
+
+	TEST_CASE("xLevelGeneratorTest", "[skip-list-levels]")
+	{
+		// every key here XORs to 0xFF, so flipCoin always says heads
+		std::vector<std::string> keys;
+		for (char c = 'a'; c <= 'z'; c++)
+		{
+			keys.push_back(std::string(1, c) + std::string(1, static_cast<char>(c ^ 0xFF)));
+		}
+
+		SkipList<std::string, unsigned> compat;
+		SkipList<std::string, unsigned, std::allocator<std::pair<const std::string, unsigned>>, HashLevels<>> hashed;
+		for (unsigned i = 0; i < keys.size(); i++)
+		{
+			compat.insert(keys[i], i);
+			hashed.insert(keys[i], i);
+		}
+		REQUIRE( compat.height(keys[0]) == 12 );
+		REQUIRE( hashed.numLayers() < compat.numLayers() );
+		for (unsigned i = 0; i < keys.size(); i++)
+		{
+			REQUIRE( hashed.find(keys[i]) == i );
+		}
+
+		// with p = 1/4 towers average 4/3 links
+		using Quarter = SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels>;
+		Quarter quarter{XorShiftLevels(LEVEL_P_QUARTER, 42)};
+		unsigned total = 0;
+		for (unsigned i = 0; i < 20000; i++)
+		{
+			quarter.insert(i, i);
+			total += quarter.height(i);
+		}
+		REQUIRE( total > 20000 * 1.2 );
+		REQUIRE( total < 20000 * 1.5 );
+		REQUIRE( quarter.numLayers() < 16 );
+
+		Quarter invE{XorShiftLevels(LEVEL_P_INV_E, 7)};
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			invE.insert(i, i);
+		}
+		REQUIRE( invE.find(999) == 999 );
+	}
+
+	TEST_CASE("xMoveAndEmplaceTest", "[skip-list-emplace]")
+	{
+		SkipList<std::string, std::vector<unsigned>> sl;
+
+		std::string key = "a fairly long key that will not fit in SSO";
+		std::vector<unsigned> value(1000, 7);
+		REQUIRE( sl.insert(std::move(key), std::move(value)) );
+		REQUIRE( sl.find("a fairly long key that will not fit in SSO").size() == 1000 );
+
+		std::pair<SkipList<std::string, std::vector<unsigned>>::iterator, bool> r = sl.try_emplace("b", 3, 9u);
+		REQUIRE( r.second );
+		REQUIRE( r.first->second == std::vector<unsigned>(3, 9) );
+		// an existing key leaves the value alone
+		r = sl.try_emplace("b", 5, 1u);
+		REQUIRE( !r.second );
+		REQUIRE( r.first->second.size() == 3 );
+
+		r = sl.emplace("c", std::vector<unsigned>{1, 2});
+		REQUIRE( r.second );
+		REQUIRE( !sl.emplace("c", std::vector<unsigned>{}).second );
+		REQUIRE( sl.find("c").size() == 2 );
+
+		r = sl.insert_or_assign("c", std::vector<unsigned>{4});
+		REQUIRE( !r.second );
+		REQUIRE( sl.find("c") == std::vector<unsigned>{4} );
+		r = sl.insert_or_assign(std::string("d"), std::vector<unsigned>{5});
+		REQUIRE( r.second );
+		REQUIRE( r.first->first == "d" );
+		REQUIRE( sl.size() == 4 );
+		REQUIRE( sl.nextKey("c") == "d" );
+	}
+
+	TEST_CASE("xUpsertTest", "[skip-list-upsert]")
+	{
+		SkipList<std::string, unsigned> counts;
+		std::vector<std::string> words = {"to", "be", "or", "not", "to", "be"};
+		for (const std::string & w : words)
+		{
+			counts[w]++;
+		}
+		REQUIRE( counts.size() == 4 );
+		REQUIRE( counts.find("to") == 2 );
+		REQUIRE( counts.find("not") == 1 );
+
+		unsigned calls = 0;
+		auto factory = [&calls]() { calls++; return 100u; };
+		REQUIRE( counts.findOrInsert("be", factory) == 2 );
+		REQUIRE( calls == 0 );
+		counts.findOrInsert("question", factory) += 1;
+		REQUIRE( calls == 1 );
+		REQUIRE( counts.find("question") == 101 );
+		REQUIRE( counts.nextKey("or") == "question" );
+	}
+
+	TEST_CASE("xNonThrowingLookupTest", "[skip-list-lookup]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		REQUIRE( !sl.contains(0) );
+		REQUIRE( sl.tryFind(0) == nullptr );
+		REQUIRE( !sl.tryNextKey(0) );
+		for (unsigned i = 1; i <= 5; i++)
+		{
+			sl.insert(i * 10, i);
+		}
+		REQUIRE( sl.contains(30) );
+		REQUIRE( !sl.contains(31) );
+		*sl.tryFind(30) = 33;
+		REQUIRE( sl.find(30) == 33 );
+
+		const SkipList<unsigned, unsigned> & csl = sl;
+		REQUIRE( *csl.tryFind(30) == 33 );
+		REQUIRE( csl.tryFind(31) == nullptr );
+		REQUIRE( *csl.tryNextKey(30) == 40 );
+		REQUIRE( *csl.tryPreviousKey(30) == 20 );
+		REQUIRE( !csl.tryNextKey(50) );
+		REQUIRE( !csl.tryPreviousKey(10) );
+		REQUIRE( !csl.tryPreviousKey(35) );
+
+		ConcurrentSkipList<unsigned, unsigned> csk;
+		csk.insert(1, 10);
+		csk.insert(2, 20);
+		REQUIRE( *csk.tryFind(2) == 20 );
+		REQUIRE( !csk.tryFind(3) );
+		REQUIRE( *csk.tryNextKey(1) == 2 );
+		REQUIRE( !csk.tryPreviousKey(1) );
+	}
+
+	TEST_CASE("xExtremeIntegralKeysTest", "[skip-list-integral]")
+	{
+		// the largest key shares its value with the tail sentinel's key
+		unsigned const LARGEST = std::numeric_limits<unsigned>::max();
+		SkipList<unsigned, unsigned> sl;
+		REQUIRE( !sl.contains(LARGEST) );
+		REQUIRE( sl.lower_bound(LARGEST) == sl.end() );
+		sl.insert(LARGEST, 1);
+		sl.insert(0, 2);
+		sl.insert(LARGEST - 1, 3);
+		REQUIRE( sl.find(LARGEST) == 1 );
+		REQUIRE( sl.nextKey(LARGEST - 1) == LARGEST );
+		REQUIRE( !sl.tryNextKey(LARGEST) );
+		REQUIRE( sl.lower_bound(LARGEST)->second == 1 );
+		REQUIRE( sl.upper_bound(LARGEST) == sl.end() );
+		REQUIRE( sl.erase(LARGEST) );
+		REQUIRE( sl.lower_bound(LARGEST) == sl.end() );
+
+		SkipList<int, int> signedKeys;
+		for (int i = -50; i < 50; i++)
+		{
+			signedKeys.insert(i, -i);
+		}
+		signedKeys.insert(std::numeric_limits<int>::min(), 0);
+		REQUIRE( signedKeys.find(-50) == 50 );
+		REQUIRE( signedKeys.nextKey(std::numeric_limits<int>::min()) == -50 );
+		REQUIRE( signedKeys.lower_bound(49)->first == 49 );
+		REQUIRE( signedKeys.lower_bound(50) == signedKeys.end() );
+	}
+	TEST_CASE("xRankTest", "[skip-list-rank]")
+	{
+		using RankedList = SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, true>;
+		RankedList sl;
+		REQUIRE( sl.rankOf(5) == 0 );
+		REQUIRE_THROWS_AS( sl.keyAtRank(0), RuntimeException );
+
+		std::vector<unsigned> keys;
+		for (unsigned i = 0; i < 2000; i++)
+		{
+			unsigned k = (i * 7919u) % 3001u;
+			if (sl.insert(k, i))
+			{
+				keys.push_back(k);
+			}
+		}
+		// erase by key and by iterator both have to fix the spans
+		for (unsigned k = 0; k < 3001; k += 5)
+		{
+			if (sl.erase(k))
+			{
+				keys.erase(std::find(keys.begin(), keys.end(), k));
+			}
+		}
+		for (auto it = sl.begin(); it != sl.end();)
+		{
+			if (it->first % 7 == 3)
+			{
+				keys.erase(std::find(keys.begin(), keys.end(), it->first));
+				it = sl.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		sl.insert(sl.begin(), 3000, 0);
+		sl.extract(1);
+		std::vector<std::pair<unsigned, unsigned>> more{{3005, 0}, {3002, 0}, {3010, 0}, {3002, 1}};
+		sl.insertBatch(more.begin(), more.end());
+		keys.push_back(3000);
+		keys.push_back(3005);
+		keys.push_back(3002);
+		keys.push_back(3010);
+		keys.erase(std::find(keys.begin(), keys.end(), 1));
+		std::sort(keys.begin(), keys.end());
+
+		REQUIRE( sl.size() == keys.size() );
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE( sl.keyAtRank(i) == keys[i] );
+			REQUIRE( sl.rankOf(keys[i]) == i );
+		}
+		REQUIRE_THROWS_AS( sl.keyAtRank(keys.size()), RuntimeException );
+		REQUIRE( sl.rankOf(5000) == keys.size() );
+		REQUIRE( sl.countInRange(100, 200) ==
+			static_cast<size_t>(std::lower_bound(keys.begin(), keys.end(), 200u) - std::lower_bound(keys.begin(), keys.end(), 100u)) );
+		REQUIRE( sl.countInRange(200, 100) == 0 );
+
+		// bulk load sets the spans without any search
+		std::vector<std::pair<unsigned, unsigned>> sorted;
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			sorted.emplace_back(2 * i, i);
+		}
+		sl.assignSorted(sorted.begin(), sorted.end());
+		REQUIRE( sl.keyAtRank(0) == 0 );
+		REQUIRE( sl.keyAtRank(999) == 1998 );
+		REQUIRE( sl.rankOf(1001) == 501 );
+		sl.insert(1001, 0);
+		REQUIRE( sl.keyAtRank(501) == 1001 );
+		REQUIRE( sl.keyAtRank(502) == 1002 );
+		REQUIRE( sl.countInRange(0, 2000) == 1001 );
+	}
+	TEST_CASE("xMinMaxTest", "[skip-list-ends]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		REQUIRE_THROWS_AS( sl.minKey(), RuntimeException );
+		REQUIRE_THROWS_AS( sl.back(), RuntimeException );
+		REQUIRE_THROWS_AS( sl.popFront(), RuntimeException );
+		REQUIRE_THROWS_AS( sl.popBack(), RuntimeException );
+		REQUIRE_THROWS_AS( sl.isSmallestKey(0), RuntimeException );
+		REQUIRE_THROWS_AS( sl.isLargestKey(0), RuntimeException );
+
+		for (unsigned i = 10; i <= 100; i += 10)
+		{
+			sl.insert(i, i + 1);
+		}
+		REQUIRE( sl.minKey() == 10 );
+		REQUIRE( sl.maxKey() == 100 );
+		REQUIRE( sl.isSmallestKey(10) );
+		REQUIRE( !sl.isSmallestKey(20) );
+		REQUIRE( sl.isLargestKey(100) );
+		REQUIRE( !sl.isLargestKey(90) );
+		REQUIRE_THROWS_AS( sl.isSmallestKey(15), RuntimeException );
+		REQUIRE_THROWS_AS( sl.isLargestKey(15), RuntimeException );
+		sl.front().second = 7;
+		REQUIRE( sl.find(10) == 7 );
+		REQUIRE( sl.back().second == 101 );
+
+		// drain it like a priority queue from both ends
+		REQUIRE( sl.popFront() == std::make_pair(10u, 7u) );
+		REQUIRE( sl.popBack() == std::make_pair(100u, 101u) );
+		REQUIRE( sl.minKey() == 20 );
+		REQUIRE( sl.maxKey() == 90 );
+		unsigned expect = 20;
+		while (!sl.isEmpty())
+		{
+			REQUIRE( sl.popFront().first == expect );
+			expect += 10;
+		}
+		REQUIRE( expect == 100 );
+		REQUIRE( sl.numLayers() == 2 );
+		sl.insert(5, 5);
+		REQUIRE( sl.minKey() == 5 );
+		REQUIRE( sl.maxKey() == 5 );
+
+		using RankedList = SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, true>;
+		RankedList ranked;
+		for (unsigned i = 0; i < 500; i++)
+		{
+			ranked.insert(i, i);
+		}
+		REQUIRE( ranked.popFront().first == 0 );
+		REQUIRE( ranked.popBack().first == 499 );
+		REQUIRE( ranked.keyAtRank(0) == 1 );
+		REQUIRE( ranked.keyAtRank(497) == 498 );
+		REQUIRE( ranked.rankOf(250) == 249 );
+		REQUIRE( ranked.middle()->first == 250 );
+
+		// middle() splits in about half without walking the list
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels> halves;
+		const auto & constHalves = halves;
+		REQUIRE( constHalves.middle() == constHalves.end() );
+		halves.insert(1, 1);
+		REQUIRE( halves.middle()->first == 1 );
+		halves.insert(2, 2);
+		REQUIRE( halves.middle()->first == 2 );
+		for (unsigned i = 3; i <= 10000; i++)
+		{
+			halves.insert(i, i);
+		}
+		REQUIRE( halves.middle()->first > 2500 );
+		REQUIRE( halves.middle()->first < 7500 );
+	}
+	TEST_CASE("xStatsTest", "[skip-list-stats]")
+	{
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels> sl;
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			sl.insert(i, i);
+		}
+		std::vector<size_t> histogram = sl.layerHistogram();
+		REQUIRE( histogram.size() == sl.numLayers() );
+		REQUIRE( histogram[0] == 1000 );
+		REQUIRE( histogram.back() == 0 );
+		size_t links = 0;
+		for (size_t i = 1; i < histogram.size(); i++)
+		{
+			REQUIRE( histogram[i] <= histogram[i - 1] );
+			links += histogram[i];
+		}
+		for (unsigned i = 0; i < 1000; i += 3)
+		{
+			sl.find(i);
+		}
+
+		SkipListStats stats = sl.stats();
+		if (SkipListStats::enabled)
+		{
+			// 1000 inserts plus 334 finds
+			REQUIRE( stats.searches == 1334 );
+			REQUIRE( stats.inserts == 1000 );
+			REQUIRE( stats.promotions == links );
+			REQUIRE( stats.averageSearchSteps() > 0 );
+			sl.resetStats();
+			REQUIRE( sl.stats().searches == 0 );
+		}
+		else
+		{
+			REQUIRE( stats.searches == 0 );
+			REQUIRE( stats.averageSearchSteps() == 0 );
+		}
+	}
+	TEST_CASE("xSnapshotTest", "[skip-list-snapshot]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 3000; i++)
+		{
+			sl.insert((i * 7919u) % 10007u, i);
+		}
+		std::stringstream snapshot;
+		sl.save(snapshot);
+
+		SkipList<unsigned, unsigned> copy;
+		copy.insert(5, 5);
+		copy.load(snapshot);
+		REQUIRE( copy.size() == sl.size() );
+		REQUIRE( copy.numLayers() == sl.numLayers() );
+		REQUIRE( copy.layerHistogram() == sl.layerHistogram() );
+		for (auto it = sl.begin(); it != sl.end(); ++it)
+		{
+			REQUIRE( copy.height(it->first) == sl.height(it->first) );
+			REQUIRE( copy.find(it->first) == it->second );
+		}
+
+		// a Ranked list gets its spans back too
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, FlipCoinLevels, true> ranked;
+		std::stringstream again(snapshot.str());
+		ranked.load(again);
+		std::vector<unsigned> keys = sl.allKeysInOrder();
+		for (size_t i = 0; i < keys.size(); i += 97)
+		{
+			REQUIRE( ranked.keyAtRank(i) == keys[i] );
+			REQUIRE( ranked.rankOf(keys[i]) == i );
+		}
+
+		// variable-width keys and values are length-prefixed
+		SkipList<std::string, std::string> words;
+		words.insert("pear", "");
+		words.insert("apple", "red");
+		words.insert("fig", std::string(5000, 'f'));
+		std::stringstream wordSnapshot;
+		words.save(wordSnapshot);
+		SkipList<std::string, std::string> wordCopy;
+		wordCopy.load(wordSnapshot);
+		REQUIRE( wordCopy.allKeysInOrder() == words.allKeysInOrder() );
+		REQUIRE( wordCopy.find("fig") == std::string(5000, 'f') );
+		REQUIRE( wordCopy.find("pear").empty() );
+
+		// bad input leaves the list empty
+		std::stringstream garbage("definitely not a snapshot, just some text");
+		REQUIRE_THROWS_AS( copy.load(garbage), RuntimeException );
+		REQUIRE( copy.isEmpty() );
+		std::stringstream otherTypes(wordSnapshot.str());
+		REQUIRE_THROWS_AS( copy.load(otherTypes), RuntimeException );
+		std::stringstream truncated(snapshot.str().substr(0, snapshot.str().size() / 2));
+		REQUIRE_THROWS_AS( copy.load(truncated), RuntimeException );
+		REQUIRE( copy.isEmpty() );
+
+		// the mapped view answers the same lookups without loading anything
+		std::string path = "xSnapshotTest.bin";
+		{
+			std::ofstream file(path, std::ios::binary);
+			sl.save(file);
+		}
+		{
+			SnapshotView<unsigned, unsigned> view(path);
+			REQUIRE( view.size() == sl.size() );
+			REQUIRE( view.numLayers() == sl.numLayers() );
+			for (unsigned k = 0; k < 10010; k++)
+			{
+				const unsigned * v = view.tryFind(k);
+				const unsigned * expected = sl.tryFind(k);
+				REQUIRE( (v == nullptr) == (expected == nullptr) );
+				if (v != nullptr)
+				{
+					REQUIRE( *v == *expected );
+				}
+				auto lb = view.lower_bound(k);
+				auto slb = sl.lower_bound(k);
+				REQUIRE( (lb == view.end()) == (slb == sl.end()) );
+				if (lb != view.end())
+				{
+					REQUIRE( lb->key == slb->first );
+				}
+			}
+			REQUIRE_THROWS_AS( view.find(10008), RuntimeException );
+		}
+		REQUIRE_THROWS_AS( (SnapshotView<unsigned, double>(path)), RuntimeException );
+		std::remove(path.c_str());
+		REQUIRE_THROWS_AS( (SnapshotView<unsigned, unsigned>(path)), RuntimeException );
+	}
+	TEST_CASE("xMergeSplitTest", "[skip-list-merge]")
+	{
+		SkipList<unsigned, unsigned> evens, threes;
+		for (unsigned i = 0; i < 600; i += 2)
+		{
+			evens.insert(i, 1);
+		}
+		for (unsigned i = 0; i < 900; i += 3)
+		{
+			threes.insert(i, 2);
+		}
+
+		SkipList<unsigned, unsigned> both, common, onlyEvens;
+		both.assignUnion(evens, threes);
+		common.assignIntersection(evens, threes);
+		onlyEvens.assignDifference(evens, threes);
+		std::vector<unsigned> u, c, d;
+		for (unsigned i = 0; i < 900; i++)
+		{
+			bool e = i < 600 && i % 2 == 0, t = i % 3 == 0;
+			if (e || t) { u.push_back(i); }
+			if (e && t) { c.push_back(i); }
+			if (e && !t) { d.push_back(i); }
+		}
+		REQUIRE( both.allKeysInOrder() == u );
+		REQUIRE( common.allKeysInOrder() == c );
+		REQUIRE( onlyEvens.allKeysInOrder() == d );
+		REQUIRE( both.find(6) == 1 );
+		REQUIRE( both.find(9) == 2 );
+		REQUIRE_THROWS_AS( both.assignUnion(both, evens), RuntimeException );
+
+		// merging splices the nodes; ours win on shared keys
+		both.merge(std::move(threes));
+		REQUIRE( threes.isEmpty() );
+		REQUIRE( threes.numLayers() == 2 );
+		REQUIRE( both.allKeysInOrder() == u );
+		REQUIRE( both.find(6) == 1 );
+		threes.insert(3, 3);
+		REQUIRE( threes.size() == 1 );
+
+		// lists from different arenas cannot share nodes, so merge moves
+		// the elements into new ones
+		using ArenaList = SkipList<unsigned, std::string, ArenaAllocator<std::pair<const unsigned, std::string>>>;
+		ArenaList left, right;
+		left.insert(1, "one");
+		right.insert(2, "two");
+		right.insert(1, "uno");
+		left.merge(std::move(right));
+		REQUIRE( right.isEmpty() );
+		REQUIRE( left.find(1) == "one" );
+		REQUIRE( left.find(2) == "two" );
+
+		// split cuts every layer after the predecessor
+		SkipList<unsigned, unsigned> upper;
+		upper.insert(12345, 0);
+		both.split(400, upper);
+		std::vector<unsigned> low(u.begin(), std::lower_bound(u.begin(), u.end(), 400u));
+		std::vector<unsigned> high(std::lower_bound(u.begin(), u.end(), 400u), u.end());
+		REQUIRE( both.allKeysInOrder() == low );
+		REQUIRE( upper.allKeysInOrder() == high );
+		REQUIRE( both.size() == low.size() );
+		REQUIRE( upper.size() == high.size() );
+		REQUIRE( both.maxKey() == low.back() );
+		REQUIRE( upper.minKey() == high.front() );
+		std::vector<unsigned> backwards;
+		for (auto it = upper.rbegin(); it != upper.rend(); ++it)
+		{
+			backwards.push_back(it->first);
+		}
+		REQUIRE( backwards == std::vector<unsigned>(high.rbegin(), high.rend()) );
+		// both halves keep working as ordinary lists
+		REQUIRE( both.insert(401, 0) );
+		REQUIRE( upper.insert(1, 0) );
+		REQUIRE( upper.erase(high.back()) );
+		REQUIRE( both.lower_bound(400)->first == 401 );
+		REQUIRE( upper.nextKey(1) == high.front() );
+		upper.split(0, both);
+		REQUIRE( upper.isEmpty() );
+		REQUIRE( both.size() == high.size() );
+
+		// a Ranked list keeps its spans across merge and split
+		using RankedList = SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, true>;
+		RankedList r1, r2, r3;
+		for (unsigned i = 0; i < 500; i++)
+		{
+			r1.insert(2 * i, i);
+			r2.insert(2 * i + 1, i);
+		}
+		r1.merge(std::move(r2));
+		for (size_t i = 0; i < 1000; i += 7)
+		{
+			REQUIRE( r1.keyAtRank(i) == i );
+		}
+		r1.split(300, r3);
+		REQUIRE( r1.size() == 300 );
+		REQUIRE( r3.size() == 700 );
+		for (size_t i = 0; i < 300; i += 7)
+		{
+			REQUIRE( r1.keyAtRank(i) == i );
+			REQUIRE( r3.keyAtRank(i) == i + 300 );
+		}
+		REQUIRE( r3.rankOf(999) == 699 );
+		r1.insert(1000, 0);
+		REQUIRE( r1.keyAtRank(300) == 1000 );
+	}
+	TEST_CASE("xShardedTest", "[skip-list-sharded]")
+	{
+		ShardedSkipList<unsigned, unsigned> sharded(std::vector<unsigned>{1000, 2000, 3000});
+		REQUIRE( sharded.shardCount() == 4 );
+		REQUIRE_THROWS_AS( (ShardedSkipList<unsigned, unsigned>(std::vector<unsigned>{5, 5})), RuntimeException );
+
+		// one writer per shard, plus a reader hammering all of them
+		std::vector<std::thread> writers;
+		for (unsigned t = 0; t < 4; t++)
+		{
+			writers.emplace_back([&sharded, t]() {
+				for (unsigned i = 0; i < 1000; i++)
+				{
+					sharded.insert(t * 1000 + i, i);
+				}
+			});
+		}
+		std::atomic<bool> done(false);
+		std::atomic<unsigned> badReads(0);
+		std::thread reader([&]() {
+			while (!done.load())
+			{
+				std::vector<unsigned> keys = sharded.allKeysInOrder();
+				if (!std::is_sorted(keys.begin(), keys.end()))
+				{
+					badReads++;
+				}
+			}
+		});
+		for (auto & w : writers)
+		{
+			w.join();
+		}
+		done = true;
+		reader.join();
+		REQUIRE( badReads == 0 );
+		REQUIRE( sharded.size() == 4000 );
+		REQUIRE( sharded.shardSizes() == std::vector<size_t>{1000, 1000, 1000, 1000} );
+		REQUIRE( sharded.find(2500) == 500 );
+		REQUIRE( !sharded.tryFind(4000) );
+		REQUIRE_THROWS_AS( sharded.find(4000), RuntimeException );
+
+		// a range scan stitches the shards together
+		std::vector<unsigned> seen;
+		sharded.forEachInRange(990, 2010, [&seen](unsigned k, unsigned) { seen.push_back(k); });
+		REQUIRE( seen.size() == 1020 );
+		REQUIRE( seen.front() == 990 );
+		REQUIRE( seen.back() == 2009 );
+		REQUIRE( std::is_sorted(seen.begin(), seen.end()) );
+
+		// writes piling into the last shard move half of it next door
+		REQUIRE( !sharded.rebalance() ); // the inserts were spread evenly
+		for (unsigned i = 0; i < 1000; i += 2)
+		{
+			sharded.erase(3000 + i);
+		}
+		REQUIRE( sharded.rebalance() );
+		std::vector<unsigned> bounds = sharded.splitPoints();
+		REQUIRE( bounds[0] == 1000 );
+		REQUIRE( bounds[1] == 2000 );
+		// the new boundary is near, not exactly at, the shard's median
+		REQUIRE( bounds[2] > 3001 );
+		REQUIRE( bounds[2] <= 3999 );
+		std::vector<size_t> sizes = sharded.shardSizes();
+		REQUIRE( sizes[0] == 1000 );
+		REQUIRE( sizes[1] == 1000 );
+		REQUIRE( sizes[2] > 1000 );
+		REQUIRE( sizes[3] > 0 );
+		REQUIRE( sizes[2] + sizes[3] == 1500 );
+		REQUIRE( !sharded.rebalance() ); // counters start over
+		REQUIRE( sharded.size() == 3500 );
+		REQUIRE( sharded.contains(3001) );
+		REQUIRE( sharded.contains(3999) );
+		REQUIRE( !sharded.contains(3000) );
+
+		// boundaries from a sample, rebalancing on its own
+		std::vector<unsigned> sample;
+		for (unsigned i = 0; i < 100; i++)
+		{
+			sample.push_back(i * 10);
+		}
+		ShardedSkipList<unsigned, unsigned> sampled(4, sample.begin(), sample.end());
+		REQUIRE( sampled.splitPoints() == std::vector<unsigned>{250, 500, 750} );
+		sampled.setAutoRebalance(100);
+		for (unsigned i = 0; i < 100; i++)
+		{
+			sampled.insert(i, i);
+		}
+		// the background rebalancer moves part of the hot first shard on
+		for (int i = 0; i < 400 && sampled.splitPoints()[0] == 250; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		REQUIRE( sampled.splitPoints()[0] > 0 );
+		REQUIRE( sampled.splitPoints()[0] < 100 );
+		std::vector<size_t> sampledSizes = sampled.shardSizes();
+		REQUIRE( sampledSizes[0] > 0 );
+		REQUIRE( sampledSizes[0] + sampledSizes[1] == 100 );
+		REQUIRE( sampled.allKeysInOrder().size() == 100 );
+	}
+	TEST_CASE("xParallelTest", "[skip-list-parallel]")
+	{
+		// shuffled pairs with some keys repeated; the earliest pair wins
+		std::vector<std::pair<unsigned, unsigned>> input;
+		for (unsigned i = 0; i < 50000; i++)
+		{
+			input.emplace_back((i * 7919u) % 40000u, i);
+		}
+		SkipList<unsigned, unsigned> serial, parallel;
+		std::vector<std::pair<unsigned, unsigned>> sorted = input;
+		std::stable_sort(sorted.begin(), sorted.end(),
+		                 [](const auto & a, const auto & b) { return a.first < b.first; });
+		sorted.erase(std::unique(sorted.begin(), sorted.end(),
+		             [](const auto & a, const auto & b) { return a.first == b.first; }), sorted.end());
+		serial.assignSorted(sorted.begin(), sorted.end());
+		parallel.assignParallel(input.begin(), input.end(), 4);
+		REQUIRE( parallel.size() == 40000 );
+		REQUIRE( parallel.numLayers() == serial.numLayers() );
+		REQUIRE( parallel.layerHistogram() == serial.layerHistogram() );
+		REQUIRE( parallel.allKeysInOrder() == serial.allKeysInOrder() );
+		REQUIRE( parallel.find(0) == 0 );
+		REQUIRE( parallel.find(7919) == 1 );
+		REQUIRE( parallel.isSmallestKey(0) );
+		REQUIRE( parallel.isLargestKey(39999) );
+		auto last = parallel.end();
+		--last;
+		REQUIRE( last->first == 39999 );
+		parallel.erase(20000);
+		parallel.insert(40000, 0);
+		REQUIRE( parallel.size() == 40000 );
+
+		// the ordered walk, cut into runs
+		std::vector<unsigned> keys = parallel.parallelAllKeysInOrder(4);
+		REQUIRE( keys == parallel.allKeysInOrder() );
+		std::atomic<unsigned long long> sum(0);
+		parallel.parallelForEach([&sum](const std::pair<const unsigned, unsigned> & kv) {
+			sum += kv.first;
+		}, 4);
+		REQUIRE( sum == 39999ull * 40000 / 2 - 20000 + 40000 );
+		parallel.parallelForEach([](std::pair<const unsigned, unsigned> & kv) { kv.second = 1; });
+		REQUIRE( parallel.find(123) == 1 );
+		REQUIRE_THROWS_AS( parallel.parallelForEach([](const std::pair<const unsigned, unsigned> & kv) {
+			if (kv.first == 30000) { throw RuntimeException("stop"); }
+		}, 4), RuntimeException );
+
+		// a Ranked list gets its spans too
+		using RankedList = SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, true>;
+		RankedList ranked;
+		ranked.assignParallel(input.begin(), input.end(), 3);
+		for (unsigned i = 0; i < 40000; i += 997)
+		{
+			REQUIRE( ranked.keyAtRank(i) == i );
+			REQUIRE( ranked.rankOf(i) == i );
+		}
+		REQUIRE( ranked.countInRange(100, 30100) == 30000 );
+
+		// a comparison that throws on a worker thread comes back out here,
+		// before the list was touched
+		struct Picky
+		{
+			bool operator()(unsigned a, unsigned b) const
+			{
+				if (a == 31337 || b == 31337) { throw RuntimeException("picky"); }
+				return a < b;
+			}
+		};
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, false, Picky> picky;
+		picky.insert(1, 1);
+		REQUIRE_THROWS_AS( picky.assignParallel(input.begin(), input.end(), 4), RuntimeException );
+		REQUIRE( picky.size() == 1 );
+		REQUIRE( picky.find(1) == 1 );
+
+		SkipList<unsigned, unsigned> empty;
+		empty.assignParallel(input.begin(), input.begin());
+		REQUIRE( empty.isEmpty() );
+		REQUIRE( empty.parallelAllKeysInOrder().empty() );
+	}
+	TEST_CASE("xFindManyTest", "[skip-list-find-many]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		for (unsigned i = 0; i < 5000; i += 2)
+		{
+			sl.insert(i, i * 3);
+		}
+		// more keys than one interleaved group, hits and misses mixed
+		std::vector<unsigned> keys;
+		for (unsigned i = 0; i < 300; i++)
+		{
+			keys.push_back((i * 37) % 5100);
+		}
+		std::vector<unsigned*> values = sl.findMany(keys);
+		REQUIRE( values.size() == keys.size() );
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			REQUIRE( values[i] == sl.tryFind(keys[i]) );
+		}
+		*values[0] = 7;
+		REQUIRE( sl.find(0) == 7 );
+
+		const SkipList<unsigned, unsigned> & view = sl;
+		std::vector<const unsigned*> few = view.findMany({4998, 4999, 5000, 2});
+		REQUIRE( *few[0] == 4998 * 3 );
+		REQUIRE( few[1] == nullptr );
+		REQUIRE( few[2] == nullptr );
+		REQUIRE( *few[3] == 6 );
+		REQUIRE( view.findMany({}).empty() );
+
+		SkipList<unsigned, unsigned> none;
+		REQUIRE( none.findMany({1, 2, 3}) == std::vector<unsigned*>(3, nullptr) );
+	}
+	TEST_CASE("xCompareTest", "[skip-list-compare]")
+	{
+		// a descending order; integral keys under it cannot use tail as +inf
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels, false,
+		         std::greater<unsigned>> down;
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			down.insert((i * 389) % 1000, i);
+		}
+		std::vector<unsigned> keys = down.allKeysInOrder();
+		REQUIRE( keys.size() == 1000 );
+		REQUIRE( keys.front() == 999 );
+		REQUIRE( std::is_sorted(keys.begin(), keys.end(), std::greater<unsigned>()) );
+		REQUIRE( down.contains(0) );
+		REQUIRE( down.lower_bound(4000) == down.begin() );
+		REQUIRE( down.lower_bound(500)->first == 500 );
+		REQUIRE( down.upper_bound(500)->first == 499 );
+		REQUIRE( down.isSmallestKey(999) );
+		REQUIRE( down.isLargestKey(0) );
+		REQUIRE( down.nextKey(10) == 9 );
+		REQUIRE( down.erase(999) );
+		REQUIRE( down.minKey() == 998 );
+
+		// transparent lookups straight from a string_view or a C string
+		using Names = SkipList<std::string, int, std::allocator<std::pair<const std::string, int>>,
+		                       XorShiftLevels, false, std::less<>>;
+		Names names;
+		names.insert("carol", 3);
+		names.insert("alice", 1);
+		names.insert("bob", 2);
+		const char buffer[] = "xxbobxx";
+		std::string_view bob(buffer + 2, 3);
+		REQUIRE( names.contains(bob) );
+		REQUIRE( names.find(bob) == 2 );
+		REQUIRE( *names.tryFind("alice") == 1 );
+		REQUIRE( names.tryFind(std::string_view("dave")) == nullptr );
+		REQUIRE_THROWS_AS( names.find(std::string_view("dave")), RuntimeException );
+		REQUIRE( names.lower_bound(std::string_view("b"))->first == "bob" );
+		REQUIRE( names.upper_bound(bob)->first == "carol" );
+		names.find(bob) = 20;
+		const Names & view = names;
+		REQUIRE( view.find(bob) == 20 );
+		REQUIRE( view.lower_bound("c")->second == 3 );
+		REQUIRE( std::is_same<decltype(names.key_comp()), std::less<>>::value );
+	}
+	TEST_CASE("xStringPrefixTest", "[skip-list-prefix]")
+	{
+		// keys that tie on their first 8 bytes, are shorter than 8, hold
+		// '\0' or bytes above 0x7f: the cached prefixes must still agree
+		// with std::string's order
+		std::vector<std::string> keys = {"https://a.example/1", "https://a.example/2", "https://", "https:/",
+		                                 "", "a", std::string("a\0", 2), std::string("a\0b", 3), "\xff", "\x80zz",
+		                                 "https://b", "zzzzzzzzzzzz", "zzzzzzzz", "zzzzzzzy"};
+		for (unsigned i = 0; i < 200; i++)
+		{
+			keys.push_back("https://host/" + std::to_string(i * 7919 % 1000));
+		}
+		SkipList<std::string, unsigned> sl;
+		std::set<std::string> expected;
+		for (unsigned i = 0; i < keys.size(); i++)
+		{
+			sl.insert(keys[i], i);
+			expected.insert(keys[i]);
+		}
+		REQUIRE( sl.allKeysInOrder() == std::vector<std::string>(expected.begin(), expected.end()) );
+		for (const std::string & k : expected)
+		{
+			REQUIRE( sl.contains(k) );
+			REQUIRE( sl.lower_bound(k)->first == k );
+		}
+		REQUIRE( !sl.contains("https://host/1000") );
+		REQUIRE( !sl.contains(std::string("a\0\0", 3)) );
+		REQUIRE( sl.upper_bound("a")->first == std::string("a\0", 2) );
+		REQUIRE( sl.lower_bound("\x81")->first == "\xff" );
+		REQUIRE( sl.erase("https://") );
+		REQUIRE( sl.nextKey("https:/") == "https://a.example/1" );
+
+		// the same through a transparent order and string_view lookups
+		SkipList<std::string, unsigned, std::allocator<std::pair<const std::string, unsigned>>, FlipCoinLevels,
+		         false, std::less<>> views;
+		for (const std::string & k : expected)
+		{
+			views.insert(k, 0);
+		}
+		for (const std::string & k : expected)
+		{
+			REQUIRE( views.contains(std::string_view(k)) );
+		}
+		REQUIRE( views.lower_bound(std::string_view("https://host/"))->first == "https://host/0" );
+		REQUIRE( views.lower_bound("zzzzzzzz!")->first == "zzzzzzzzzzzz" );
+	}
+	TEST_CASE("xSnapshotViewTest", "[concurrent-snapshot]")
+	{
+		ConcurrentSkipList<unsigned, unsigned> csk;
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			csk.insert(i, i);
+		}
+		{
+			auto before = csk.snapshot();
+			for (unsigned i = 0; i < 1000; i += 2)
+			{
+				REQUIRE( csk.erase(i) );
+			}
+			REQUIRE( csk.insert(10, 77) ); // a new version of an erased key
+			REQUIRE( csk.insert(5000, 1) );
+			REQUIRE( !csk.contains(12) );
+			REQUIRE( csk.find(10) == 77 );
+			REQUIRE( csk.size() == 502 );
+			REQUIRE( csk.tryPreviousKey(13) == 11u );
+			REQUIRE( csk.nextKey(9) == 10 );
+			REQUIRE( csk.nextKey(11) == 13 );
+
+			// the snapshot still reads the list as it was
+			REQUIRE( before.contains(12) );
+			REQUIRE( before.find(10) == 10 );
+			REQUIRE( !before.contains(5000) );
+			REQUIRE_THROWS_AS( before.find(5000), RuntimeException );
+			std::vector<unsigned> all = before.allKeysInOrder();
+			REQUIRE( all.size() == 1000 );
+			REQUIRE( all.back() == 999 );
+			REQUIRE( before.lower_bound(500).key() == 500 );
+			REQUIRE( before.lower_bound(500).value() == 500 );
+
+			auto after = csk.snapshot();
+			REQUIRE( after.version() > before.version() );
+			REQUIRE( after.allKeysInOrder() == csk.allKeysInOrder() );
+			REQUIRE( after.find(10) == 77 );
+			// a key erased and inserted again while a snapshot is open is
+			// still the previous key of the one after it
+			REQUIRE( csk.tryPreviousKey(11) == 10u );
+			REQUIRE( csk.previousKey(11) == 10 );
+			REQUIRE( csk.erase(10) );
+			REQUIRE( after.find(10) == 77 );
+			REQUIRE( before.find(10) == 10 );
+		}
+		// with both closed the dead versions are gone
+		REQUIRE( csk.size() == 501 );
+		REQUIRE( csk.insert(10, 3) );
+		REQUIRE( csk.find(10) == 3 );
+		REQUIRE( csk.allKeysInOrder().size() == 502 );
+
+		// scans over a snapshot stay put while a writer churns
+		std::atomic<bool> done(false);
+		std::thread writer([&]() {
+			for (unsigned round = 0; !done.load(); round++)
+			{
+				for (unsigned i = 1; i < 1000; i += 2)
+				{
+					csk.erase(i);
+					csk.insert(i, round);
+				}
+			}
+		});
+		for (unsigned scan = 0; scan < 20; scan++)
+		{
+			auto view = csk.snapshot();
+			std::vector<unsigned> first = view.allKeysInOrder();
+			std::this_thread::yield();
+			REQUIRE( view.allKeysInOrder() == first );
+			REQUIRE( std::is_sorted(first.begin(), first.end()) );
+		}
+		done = true;
+		writer.join();
+		REQUIRE( csk.size() == 502 );
+
+		ConcurrentSkipList<unsigned, unsigned> small;
+		small.insert(1, 1);
+		small.insert(2, 2);
+		small.insert(3, 3);
+		{
+			auto held = small.snapshot();
+			REQUIRE( small.erase(2) );
+			REQUIRE( small.insert(2, 20) );
+			REQUIRE( small.tryPreviousKey(3) == 2u );
+			REQUIRE( small.previousKey(3) == 2 );
+			REQUIRE( held.find(2) == 2 );
+		}
+		REQUIRE( small.tryPreviousKey(3) == 2u );
+	}
+
+	TEST_CASE("xWalTest", "[durable-skip-list]")
+	{
+		char tmpl[] = "/tmp/skiplist-walXXXXXX";
+		REQUIRE( ::mkdtemp(tmpl) != nullptr );
+		const std::string dir = tmpl;
+		auto files = [&dir]() {
+			std::vector<std::string> names;
+			DIR* d = ::opendir(dir.c_str());
+			while (dirent* e = ::readdir(d))
+			{
+				if (e->d_name[0] != '.')
+				{
+					names.push_back(e->d_name);
+				}
+			}
+			::closedir(d);
+			std::sort(names.begin(), names.end());
+			return names;
+		};
+
+		{
+			DurableSkipList<unsigned, std::string> d(dir);
+			for (unsigned i = 0; i < 100; i++)
+			{
+				REQUIRE( d.insert(i, std::to_string(i)) );
+			}
+			REQUIRE( !d.insert(5, "x") );
+			REQUIRE( d.erase(7) );
+			REQUIRE( !d.erase(7) );
+			REQUIRE( !d.insert_or_assign(8, "eight") );
+		}
+		{
+			// recovery replays the log
+			DurableSkipList<unsigned, std::string> d(dir);
+			REQUIRE( d.size() == 99 );
+			REQUIRE( !d.contains(7) );
+			REQUIRE( d.find(8) == "eight" );
+			REQUIRE( d.tryFind(99) == std::optional<std::string>("99") );
+
+			d.checkpoint();
+			REQUIRE( d.erase(0) );
+			REQUIRE( d.insert(1000, "k") );
+			// one checkpoint and only the log written since it are left
+			std::vector<std::string> names = files();
+			REQUIRE( names.size() == 2 );
+			REQUIRE( names[0].compare(0, 11, "checkpoint-") == 0 );
+			REQUIRE( names[1].compare(0, 4, "wal-") == 0 );
+		}
+		std::string last;
+		{
+			DurableSkipList<unsigned, std::string> d(dir, WalOptions{WalSync::None});
+			REQUIRE( d.size() == 99 );
+			REQUIRE( !d.contains(0) );
+			REQUIRE( d.find(1000) == "k" );
+			REQUIRE( d.read([](const auto & l) { return l.allKeysInOrder().front(); }) == 1u );
+			REQUIRE( d.insert(2000, "torn") );
+			d.sync();
+			last = dir + "/" + files().back();
+		}
+		{
+			// a record cut short by a crash is dropped, the earlier ones kept
+			struct stat st;
+			REQUIRE( ::stat(last.c_str(), &st) == 0 );
+			REQUIRE( ::truncate(last.c_str(), st.st_size - 3) == 0 );
+			REQUIRE( WriteAheadLog::readAll(last).empty() );
+			DurableSkipList<unsigned, std::string> d(dir);
+			REQUIRE( !d.contains(2000) );
+			REQUIRE( d.find(1000) == "k" );
+			REQUIRE( d.size() == 99 );
+
+			// writers group-commit concurrently, a checkpoint runs meanwhile
+			std::vector<std::thread> writers;
+			for (unsigned t = 0; t < 4; t++)
+			{
+				writers.emplace_back([&d, t]() {
+					for (unsigned i = 0; i < 200; i++)
+					{
+						d.insert_or_assign(10000 + t * 1000 + i, "w");
+					}
+				});
+			}
+			d.checkpoint();
+			for (std::thread & w : writers)
+			{
+				w.join();
+			}
+			REQUIRE( d.size() == 899 );
+		}
+		std::vector<std::pair<unsigned, std::string>> before;
+		{
+			DurableSkipList<unsigned, std::string> d(dir);
+			REQUIRE( d.size() == 899 );
+			REQUIRE( d.find(13199) == "w" );
+
+			// a checkpoint of many chunks, while writers change keys behind
+			// and ahead of the copy; replay fixes up whatever it missed
+			for (unsigned i = 0; i < 12000; i++)
+			{
+				d.insert_or_assign(100000 + i, "c");
+			}
+			std::vector<std::thread> writers;
+			for (unsigned t = 0; t < 2; t++)
+			{
+				writers.emplace_back([&d, t]() {
+					for (unsigned i = t; i < 12000; i += 7)
+					{
+						if (t == 0) {
+							d.erase(100000 + i);
+						} else {
+							d.insert_or_assign(100000 + i, "moved");
+						}
+					}
+				});
+			}
+			d.checkpoint();
+			for (std::thread & w : writers)
+			{
+				w.join();
+			}
+			before = d.read([](const auto & l) {
+				std::vector<std::pair<unsigned, std::string>> all;
+				for (const auto & kv : l) { all.emplace_back(kv.first, kv.second); }
+				return all;
+			});
+		}
+		{
+			DurableSkipList<unsigned, std::string> d(dir);
+			REQUIRE( d.read([](const auto & l) {
+				std::vector<std::pair<unsigned, std::string>> all;
+				for (const auto & kv : l) { all.emplace_back(kv.first, kv.second); }
+				return all;
+			}) == before );
+			REQUIRE( !d.contains(100000) );
+			REQUIRE( d.find(100001) == "moved" );
+		}
+		{
+			// a failed write loses its batch and what follows, until rotation
+			const std::string bad = dir + "/bad.log", good = dir + "/good.log";
+			WriteAheadLog wal(bad, WalOptions());
+			wal.commit(wal.append("kept"));
+			struct rlimit limit;
+			REQUIRE( ::getrlimit(RLIMIT_FSIZE, &limit) == 0 );
+			struct rlimit tiny = limit;
+			tiny.rlim_cur = 4096;
+			auto handler = std::signal(SIGXFSZ, SIG_IGN);
+			REQUIRE( ::setrlimit(RLIMIT_FSIZE, &tiny) == 0 );
+			uint64_t big = wal.append(std::string(8192, 'x'));
+			uint64_t after = wal.append("after");
+			bool threw = false;
+			try {
+				wal.commit(big);
+			} catch (const RuntimeException &) {
+				threw = true;
+			}
+			REQUIRE( ::setrlimit(RLIMIT_FSIZE, &limit) == 0 );
+			std::signal(SIGXFSZ, handler);
+			REQUIRE( threw );
+			REQUIRE_THROWS( wal.commit(after) );
+			uint64_t later = wal.append("later");
+			REQUIRE_THROWS( wal.commit(later) );
+			REQUIRE_THROWS( wal.sync() );
+			wal.rotate(good);
+			REQUIRE_THROWS( wal.commit(later) );
+			wal.commit(wal.append("fresh"));
+			REQUIRE( WriteAheadLog::readAll(bad) == std::vector<std::string>{"kept"} );
+			REQUIRE( WriteAheadLog::readAll(good) == std::vector<std::string>{"fresh"} );
+		}
+		{
+			// Interval mode syncs in the background with no more writes
+			const std::string ticking = dir + "/interval.log";
+			WriteAheadLog wal(ticking, WalOptions{WalSync::Interval, std::chrono::milliseconds(5)});
+			wal.commit(wal.append("tick"));
+			for (int i = 0; i < 400 && WriteAheadLog::readAll(ticking).empty(); i++)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+			REQUIRE( WriteAheadLog::readAll(ticking) == std::vector<std::string>{"tick"} );
+		}
+		for (const std::string & name : files())
+		{
+			std::remove((dir + "/" + name).c_str());
+		}
+		::rmdir(dir.c_str());
+	}
+
+	TEST_CASE("xMemtableTest", "[memtable-skip-list]")
+	{
+		char tmpl[] = "/tmp/skiplist-memtableXXXXXX";
+		REQUIRE( ::mkdtemp(tmpl) != nullptr );
+		const std::string dir = tmpl;
+		MemtableOptions options;
+		options.memtableBytes = 8192;
+		options.blockBytes = 256;
+		options.wal.sync = WalSync::None;
+
+		{
+			MemtableSkipList<unsigned, std::string> m(dir, options);
+			for (unsigned i = 0; i < 3000; i++)
+			{
+				m.insert_or_assign(i, std::to_string(i));
+			}
+			for (unsigned i = 0; i < 3000; i += 3)
+			{
+				m.erase(i);
+			}
+			m.insert_or_assign(3, "three");
+			m.flush();
+			REQUIRE( m.frozenCount() == 0 );
+			REQUIRE( m.runCount() > 5 );
+			REQUIRE( !m.contains(0) );
+			REQUIRE( m.find(3) == "three" );
+			REQUIRE( m.find(2998) == "2998" );
+			REQUIRE( !m.contains(5000) );
+			REQUIRE_THROWS_AS( m.find(2997), RuntimeException );
+
+			// these stay in the log
+			m.insert_or_assign(0, "zero");
+			m.erase(1);
+		}
+		{
+			MemtableSkipList<unsigned, std::string> m(dir, options);
+			REQUIRE( m.find(0) == "zero" );
+			REQUIRE( !m.contains(1) );
+			unsigned found = 0;
+			for (unsigned i = 0; i < 3000; i++)
+			{
+				std::optional<std::string> v = m.tryFind(i);
+				if (v)
+				{
+					REQUIRE( (*v == std::to_string(i) || i == 0 || i == 3) );
+					found++;
+				}
+			}
+			REQUIRE( found == 2001 );
+
+			// readers see every write while memtables freeze and flush
+			std::atomic<bool> done(false);
+			std::atomic<unsigned> misses(0);
+			std::thread reader([&]() {
+				while (!done.load())
+				{
+					misses += m.tryFind(2) != std::optional<std::string>("2");
+				}
+			});
+			std::vector<std::thread> writers;
+			for (unsigned t = 0; t < 3; t++)
+			{
+				writers.emplace_back([&m, t]() {
+					for (unsigned i = 0; i < 1000; i++)
+					{
+						m.insert_or_assign(10000 + t * 1000 + i, "w");
+					}
+				});
+			}
+			for (std::thread & w : writers)
+			{
+				w.join();
+			}
+			done = true;
+			reader.join();
+			REQUIRE( misses == 0 );
+			for (unsigned i = 10000; i < 13000; i++)
+			{
+				REQUIRE( m.contains(i) );
+			}
+		}
+		{
+			// failing flushes are retried; meanwhile writers are held to
+			// maxFrozen memtables, then refused
+			MemtableOptions tight = options;
+			tight.memtableBytes = 2048;
+			tight.maxFrozen = 2;
+			MemtableSkipList<unsigned, std::string> m(dir, tight);
+			m.flush();
+			struct rlimit limit;
+			REQUIRE( ::getrlimit(RLIMIT_FSIZE, &limit) == 0 );
+			struct rlimit tiny = limit;
+			tiny.rlim_cur = 64;
+			auto handler = std::signal(SIGXFSZ, SIG_IGN);
+			REQUIRE( ::setrlimit(RLIMIT_FSIZE, &tiny) == 0 );
+			unsigned written = 0;
+			bool refused = false;
+			while (written < 100000 && !refused)
+			{
+				try {
+					m.insert_or_assign(20000 + written, "f");
+					written++;
+				} catch (const RuntimeException &) {
+					refused = true;
+				}
+			}
+			size_t waiting = m.frozenCount();
+			REQUIRE( ::setrlimit(RLIMIT_FSIZE, &limit) == 0 );
+			std::signal(SIGXFSZ, handler);
+			REQUIRE( refused );
+			REQUIRE( waiting == 2 );
+			m.flush();
+			REQUIRE( m.frozenCount() == 0 );
+			unsigned kept = 0;
+			for (unsigned i = 0; i < written; i++)
+			{
+				kept += m.contains(20000 + i);
+			}
+			REQUIRE( kept == written );
+			REQUIRE( !m.contains(20000 + written) );
+		}
+
+		std::vector<std::pair<unsigned, std::optional<std::string>>> entries = {{1, "one"}, {4, std::nullopt}, {9, "nine"}};
+		SortedRun<unsigned, std::string>::write(dir + "/single", entries.begin(), entries.end(), 1);
+		{
+			SortedRun<unsigned, std::string> run(dir + "/single");
+			std::optional<std::string> v;
+			REQUIRE( run.size() == 3 );
+			REQUIRE( !run.lookup(0, v) );
+			REQUIRE( !run.lookup(5, v) );
+			REQUIRE( !run.lookup(10, v) );
+			REQUIRE( run.lookup(4, v) );
+			REQUIRE( !v );
+			REQUIRE( run.lookup(9, v) );
+			REQUIRE( *v == "nine" );
+		}
+
+		DIR* d = ::opendir(dir.c_str());
+		while (dirent* e = ::readdir(d))
+		{
+			if (e->d_name[0] != '.')
+			{
+				std::remove((dir + "/" + e->d_name).c_str());
+			}
+		}
+		::closedir(d);
+		REQUIRE( ::rmdir(dir.c_str()) == 0 );
+	}
+
+	TEST_CASE("xMemoryTest", "[skip-list-memory]")
+	{
+		SkipList<unsigned, unsigned> sl;
+		const size_t empty = sl.bytesUsed();
+		REQUIRE( sl.nodeCount() == 2 );
+		REQUIRE( sl.memoryUsage().sentinelBytes == empty );
+		for (unsigned i = 0; i < 5000; i++)
+		{
+			sl.insert(i * 7 % 5000, i);
+		}
+		SkipListMemory m = sl.memoryUsage();
+		REQUIRE( sl.nodeCount() == 5002 );
+		REQUIRE( m.nodes == 5000 );
+		REQUIRE( m.bytes == sl.bytesUsed() );
+		REQUIRE( m.layerNodes == sl.layerHistogram() );
+		REQUIRE( m.keyBytes == 5000 * sizeof(unsigned) );
+		REQUIRE( m.bytes == m.sentinelBytes + m.keyBytes + m.valueBytes + m.linkBytes + m.overheadBytes );
+		size_t links = 0;
+		for (size_t n : m.layerNodes)
+		{
+			links += n;
+		}
+		REQUIRE( m.linkBytes == links * sizeof(void*) );
+
+		for (unsigned i = 0; i < 5000; i += 2)
+		{
+			REQUIRE( sl.erase(i) );
+		}
+		REQUIRE( sl.memoryUsage().layerNodes == sl.layerHistogram() );
+		REQUIRE( sl.nodeCount() == 2502 );
+
+		// nodes moved between lists take their bytes with them
+		SkipList<unsigned, unsigned> upper;
+		size_t before = sl.bytesUsed() + upper.bytesUsed();
+		sl.split(4000, upper);
+		REQUIRE( sl.bytesUsed() + upper.bytesUsed() == before );
+		REQUIRE( upper.memoryUsage().layerNodes == upper.layerHistogram() );
+		REQUIRE( sl.memoryUsage().layerNodes == sl.layerHistogram() );
+		sl.split(100, upper); // drops what upper held
+		before = sl.bytesUsed() + upper.bytesUsed();
+		REQUIRE( sl.memoryUsage().layerNodes == sl.layerHistogram() );
+		REQUIRE( upper.memoryUsage().layerNodes == upper.layerHistogram() );
+		sl.merge(std::move(upper));
+		REQUIRE( upper.bytesUsed() == empty );
+		REQUIRE( sl.bytesUsed() == before - empty );
+		sl.clear();
+		REQUIRE( sl.bytesUsed() == empty );
+
+		std::vector<std::pair<unsigned, unsigned>> items;
+		for (unsigned i = 0; i < 50000; i++)
+		{
+			items.emplace_back(i, i);
+		}
+		sl.assignParallel(items.begin(), items.end(), 4);
+		REQUIRE( sl.memoryUsage().nodes == 50000 );
+		REQUIRE( sl.memoryUsage().layerNodes == sl.layerHistogram() );
+
+		// keys that own heap memory are counted; short ones stay inline
+		SkipList<std::string, unsigned> strings;
+		size_t bare = strings.bytesUsed();
+		strings.insert("a", 1);
+		size_t one = strings.bytesUsed();
+		strings.insert(std::string(100, 'x'), 2);
+		REQUIRE( one > bare );
+		REQUIRE( strings.memoryUsage().keyBytes >= 2 * sizeof(std::string) + 101 );
+		REQUIRE( strings.bytesUsed() - one > 101 );
+		strings.erase(std::string(100, 'x'));
+		REQUIRE( strings.bytesUsed() == one );
+	}
+
+	TEST_CASE("xMaxLayersTest", "[skip-list-max-layers]")
+	{
+		// the integer cap matches the old floating-point formula
+		for (size_t n = 16; n < 200000; n = n * 5 / 4 + 1)
+		{
+			for (size_t m : {n - 1, n, n + 1})
+			{
+				unsigned expected = m < 16 ? 13 : 3 * static_cast<unsigned>(std::ceil(std::log2(m + 1))) + 1;
+				REQUIRE( SkipList<unsigned, unsigned>::maxLayersFor(m) == expected );
+			}
+		}
+		REQUIRE( SkipList<unsigned, unsigned>::maxLayersFor(0) == 13 );
+		REQUIRE( SkipList<unsigned, unsigned>::maxLayersFor(std::numeric_limits<size_t>::max()) ==
+		         3 * std::numeric_limits<size_t>::digits + 1 );
+
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels> sl;
+		REQUIRE( sl.maxLayers() == 13 );
+		REQUIRE_THROWS_AS( sl.setMaxLayers(1), RuntimeException );
+		REQUIRE_THROWS_AS( sl.setMaxLayers(100000), RuntimeException );
+		sl.setMaxLayers(4);
+		for (unsigned i = 0; i < 20000; i++)
+		{
+			sl.insert(i, i);
+		}
+		REQUIRE( sl.maxLayers() == 4 );
+		REQUIRE( sl.numLayers() <= 4 );
+
+		// back to adapting; layers follow the list as it grows and shrinks
+		sl.setMaxLayers(0);
+		REQUIRE( sl.maxLayers() == SkipList<unsigned, unsigned>::maxLayersFor(20000) );
+		for (unsigned i = 20000; i < 40000; i++)
+		{
+			sl.insert(i, i);
+		}
+		REQUIRE( sl.numLayers() > 4 );
+		for (unsigned i = 0; i < 40000; i++)
+		{
+			sl.erase(i);
+		}
+		REQUIRE( sl.numLayers() == 2 );
+
+		// fixed up front for a known capacity
+		SkipList<unsigned, unsigned, std::allocator<std::pair<const unsigned, unsigned>>, XorShiftLevels> sized;
+		sized.setMaxLayers(SkipList<unsigned, unsigned>::maxLayersFor(1000000));
+		sized.insert(1, 1);
+		REQUIRE( sized.maxLayers() == 61 );
+	}
+}